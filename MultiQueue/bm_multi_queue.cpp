@@ -0,0 +1,505 @@
+/*!	\file	bm_multi_queue.cpp
+
+	multi_queue performance benchmarks (Google Benchmark).
+
+	The single-threaded benchmarks are parameterized by element type and priority-level count and are run
+	against fixed_priority_multi_queue, sparse_priority_multi_queue and a std::priority_queue<pair<priority, T>>
+	baseline. The threaded benchmarks run the shared concurrent queue, the work-stealing sharded queue and the
+	relaxed queue as threads are added, reporting throughput and, in BM_RankError, the rank error of the pops;
+	BM_Imbalanced feeds them from a single producer, so the sharded queue's consumers live off stealing.
+	BM_AdjacentLevels compares the packed and padded level layouts with one producer per level, and
+	BM_WakeLatency the wait strategies of blocking consumers. BM_RestoreReplay and BM_RestoreSnapshot compare
+	a warm restart by replaying pushes with one from a mapped snapshot file, BM_Combine merge() with moving
+	a queue's elements one by one, and BM_Cancel erasing tracked elements with skipping tombstoned ones.
+	Write JSON for regression tracking with
+		bm_multi_queue --benchmark_out=multi_queue.json --benchmark_out_format=json
+*/
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "multi_queue.hpp"
+
+
+// Baseline with the multi-queue interface: a binary heap ordered on priority only.
+template <class ELEMENT_T>
+class priority_queue_baseline {
+	using entry = pair<size_t, ELEMENT_T>;
+	struct later {
+		bool operator () (entry const& lhs, entry const& rhs) const noexcept { return lhs.first > rhs.first; }
+	};
+	priority_queue<entry, vector<entry>, later> heap;
+
+public:
+	using value_type = ELEMENT_T;
+	void push(ELEMENT_T const& value, size_t priority) { heap.emplace(priority, value); }
+	void pop() { heap.pop(); }
+	ELEMENT_T const& top() const { return heap.top().second; }
+	size_t size() const noexcept { return heap.size(); }
+	bool empty() const noexcept { return heap.empty(); }
+};
+
+
+template <class ELEMENT_T> ELEMENT_T make_value(size_t i);
+template <> int make_value<int>(size_t i) { return static_cast<int>(i); }
+template <> string make_value<string>(size_t i) { return "job-" + to_string(i); }
+
+
+// Priorities for n pushes: dense spreads them over every level, sparse over 16 levels scattered across the range.
+vector<size_t> make_priorities(size_t n, size_t levels, bool sparse) {
+	mt19937_64 rng(42);
+	vector<size_t> occupied;
+	if (sparse)
+		for (size_t i = 0; i < 16; ++i)
+			occupied.push_back(uniform_int_distribution<size_t>(0, levels - 1)(rng));
+
+	vector<size_t> priorities(n);
+	for (auto& p : priorities)
+		p = sparse ? occupied[rng() % occupied.size()] : rng() % levels;
+	return priorities;
+}
+
+
+constexpr size_t batch = 4096;
+
+
+// Fills the queue with a batch over range(0) levels and drains it again.
+template <class QUEUE>
+void BM_PushPop(benchmark::State& state) {
+	using value_type = typename QUEUE::value_type;
+	auto const levels = static_cast<size_t>(state.range(0));
+	auto const priorities = make_priorities(batch, levels, false);
+	auto const value = make_value<value_type>(7);
+	QUEUE queue;
+	for (auto _ : state) {
+		for (auto p : priorities)
+			queue.push(value, p);
+		while (!queue.empty()) {
+			benchmark::DoNotOptimize(&queue.top());
+			queue.pop();
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * batch);
+}
+
+
+// Latency of top() on a full queue whose only occupied level is the last one.
+template <class QUEUE>
+void BM_Top(benchmark::State& state) {
+	using value_type = typename QUEUE::value_type;
+	auto const levels = static_cast<size_t>(state.range(0));
+	QUEUE queue;
+	for (size_t i = 0; i < batch; ++i)
+		queue.push(make_value<value_type>(i), levels - 1);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(&queue.top());
+}
+
+
+// Cost of size() and empty() on a queue holding one element per level.
+template <class QUEUE>
+void BM_SizeEmpty(benchmark::State& state) {
+	using value_type = typename QUEUE::value_type;
+	auto const levels = static_cast<size_t>(state.range(0));
+	QUEUE queue;
+	for (size_t p = 0; p < levels; ++p)
+		queue.push(make_value<value_type>(p), p);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(queue.size());
+		benchmark::DoNotOptimize(queue.empty());
+	}
+}
+
+
+// Steady state at a constant depth: every iteration pops the top and pushes a new element.
+template <class QUEUE, bool SPARSE>
+void BM_Mixed(benchmark::State& state) {
+	using value_type = typename QUEUE::value_type;
+	auto const levels = static_cast<size_t>(state.range(0));
+	auto const priorities = make_priorities(batch * 2, levels, SPARSE);
+	auto const value = make_value<value_type>(7);
+	QUEUE queue;
+	for (size_t i = 0; i < batch; ++i)
+		queue.push(value, priorities[i]);
+
+	size_t next = batch;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(&queue.top());
+		queue.pop();
+		queue.push(value, priorities[next]);
+		next = next + 1 == priorities.size() ? 0 : next + 1;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+
+#define MULTI_QUEUE_BENCHMARKS(QUEUE)														\
+	BENCHMARK_TEMPLATE(BM_PushPop, QUEUE)->Arg(8)->Arg(64)->Arg(4096);						\
+	BENCHMARK_TEMPLATE(BM_Top, QUEUE)->Arg(8)->Arg(64)->Arg(4096);							\
+	BENCHMARK_TEMPLATE(BM_SizeEmpty, QUEUE)->Arg(8)->Arg(64)->Arg(4096);					\
+	BENCHMARK_TEMPLATE(BM_Mixed, QUEUE, false)->Arg(8)->Arg(64)->Arg(4096);					\
+	BENCHMARK_TEMPLATE(BM_Mixed, QUEUE, true)->Arg(4096)->Arg(65536)
+
+MULTI_QUEUE_BENCHMARKS(fixed_priority_multi_queue<int>);
+MULTI_QUEUE_BENCHMARKS(fixed_priority_multi_queue<string>);
+MULTI_QUEUE_BENCHMARKS(sparse_priority_multi_queue<int>);
+MULTI_QUEUE_BENCHMARKS(priority_queue_baseline<int>);
+MULTI_QUEUE_BENCHMARKS(priority_queue_baseline<string>);
+
+// Keys spread over a range no dense queue could allocate levels for.
+BENCHMARK_TEMPLATE(BM_Mixed, sparse_priority_multi_queue<int>, true)->Arg(1 << 30);
+BENCHMARK_TEMPLATE(BM_Mixed, priority_queue_baseline<int>, true)->Arg(1 << 30);
+
+
+
+// Warm restart of range(0) elements over 64 levels: replaying every push, against mapping a snapshot file and
+// restoring it with one bulk copy per level.
+constexpr size_t restore_levels = 64;
+
+void BM_RestoreReplay(benchmark::State& state) {
+	auto const n = static_cast<size_t>(state.range(0));
+	auto const priorities = make_priorities(n, restore_levels, false);
+	for (auto _ : state) {
+		fixed_priority_multi_queue<int> queue;
+		for (size_t i = 0; i < n; ++i)
+			queue.push(static_cast<int>(i), priorities[i]);
+		benchmark::DoNotOptimize(queue.size());
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_RestoreSnapshot(benchmark::State& state) {
+	char const* path = "bm_multi_queue_snapshot.bin";
+	auto const n = static_cast<size_t>(state.range(0));
+	auto const priorities = make_priorities(n, restore_levels, false);
+	{
+		fixed_priority_multi_queue<int> queue;
+		for (size_t i = 0; i < n; ++i)
+			queue.push(static_cast<int>(i), priorities[i]);
+		ofstream out(path, ios::binary);
+		queue.save(out);
+	}
+
+	for (auto _ : state) {
+		multi_queue_snapshot<int> snapshot(path);
+		fixed_priority_multi_queue<int> queue(snapshot);
+		benchmark::DoNotOptimize(queue.size());
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+	remove(path);
+}
+
+BENCHMARK(BM_RestoreReplay)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_RestoreSnapshot)->Arg(1 << 16)->Arg(1 << 20);
+
+
+
+// Moving every element of one queue of range(0) elements over 64 levels into another: merge(), which links the
+// chunks of each level, against popping each element and pushing it into the target. Filling the queues is
+// untimed but dominates a run, so iterations are fixed.
+template <bool MERGE>
+void BM_Combine(benchmark::State& state) {
+	using queue_type = fixed_priority_multi_queue<int, chunked_queue<int>>;
+	auto const n = static_cast<size_t>(state.range(0));
+	auto const priorities = make_priorities(n, restore_levels, false);
+	for (auto _ : state) {
+		state.PauseTiming();
+		auto target = make_unique<queue_type>();
+		auto source = make_unique<queue_type>();
+		for (size_t i = 0; i < n; ++i) {
+			target->push(static_cast<int>(i), priorities[i]);
+			source->push(static_cast<int>(i), priorities[i]);
+		}
+		state.ResumeTiming();
+
+		if constexpr (MERGE)
+			target->merge(std::move(*source));
+		else
+			for (; !source->empty(); source->pop())
+				target->push(source->top(), source->top_priority());
+		benchmark::DoNotOptimize(target->size());
+
+		state.PauseTiming();
+		target.reset();
+		source.reset();
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_TEMPLATE(BM_Combine, false)->Arg(1 << 16)->Iterations(64);
+BENCHMARK_TEMPLATE(BM_Combine, true)->Arg(1 << 16)->Iterations(64);
+
+
+
+// A batch over range(0) levels with every fourth job cancelled before the batch drains: erase() through the
+// handles of a tracked queue, against a set of cancelled ids that every pop checks.
+template <bool TRACKED>
+void BM_Cancel(benchmark::State& state) {
+	auto const levels = static_cast<size_t>(state.range(0));
+	auto const priorities = make_priorities(batch, levels, false);
+	tracked_fixed_priority_multi_queue<int> tracked;
+	vector<tracked_fixed_priority_multi_queue<int>::handle> handles(batch);
+	fixed_priority_multi_queue<int> plain;
+	unordered_set<int> cancelled;
+	for (auto _ : state) {
+		if constexpr (TRACKED) {
+			for (size_t i = 0; i < batch; ++i)
+				handles[i] = tracked.push_tracked(static_cast<int>(i), priorities[i]);
+			for (size_t i = 0; i < batch; i += 4)
+				tracked.erase(handles[i]);
+			for (; !tracked.empty(); tracked.pop())
+				benchmark::DoNotOptimize(tracked.top());
+		}
+		else {
+			for (size_t i = 0; i < batch; ++i)
+				plain.push(static_cast<int>(i), priorities[i]);
+			for (size_t i = 0; i < batch; i += 4)
+				cancelled.insert(static_cast<int>(i));
+			for (; !plain.empty(); plain.pop())
+				if (cancelled.erase(plain.top()) == 0)
+					benchmark::DoNotOptimize(plain.top());
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * batch);
+}
+
+BENCHMARK_TEMPLATE(BM_Cancel, false)->Arg(64)->Arg(4096);
+BENCHMARK_TEMPLATE(BM_Cancel, true)->Arg(64)->Arg(4096);
+
+
+
+// Uniform push/pop over the concurrent queues; the sharded queue is driven through the thread's own shard.
+template <class QUEUE>
+struct worker {
+	QUEUE& queue;
+	size_t id;
+	void push(int value, size_t priority) { queue.push(value, priority); }
+	bool pop(int& value) { return queue.try_pop(value); }
+};
+
+template <>
+struct worker<sharded_multi_queue<int>> {
+	sharded_multi_queue<int>& queue;
+	size_t id;
+	void push(int value, size_t priority) { queue.push(id, value, priority); }
+	bool pop(int& value) { return queue.try_pop(id, value); }
+};
+
+
+// Queue for a threaded run; arg is the sharded queue's relaxation bound or the relaxed queue's c.
+template <class QUEUE> unique_ptr<QUEUE> make_shared_queue(size_t threads, size_t arg);
+template <> unique_ptr<concurrent_fixed_priority_multi_queue<int>> make_shared_queue(size_t, size_t) {
+	return make_unique<concurrent_fixed_priority_multi_queue<int>>(64);
+}
+template <> unique_ptr<padded_concurrent_fixed_priority_multi_queue<int>> make_shared_queue(size_t, size_t) {
+	return make_unique<padded_concurrent_fixed_priority_multi_queue<int>>(64);
+}
+template <> unique_ptr<sharded_multi_queue<int>> make_shared_queue(size_t threads, size_t arg) {
+	return make_unique<sharded_multi_queue<int>>(threads, arg);
+}
+template <> unique_ptr<relaxed_multi_queue<int>> make_shared_queue(size_t threads, size_t arg) {
+	return make_unique<relaxed_multi_queue<int>>(threads, arg);
+}
+
+
+// Rank error of concurrent pops: the number of queued elements with a strictly better priority than the
+// popped one, read from per-priority counters. Pushes are counted before they land, so the figure is an
+// estimate under concurrency, but it is exact for a single thread.
+class rank_tracker {
+	array<atomic<long long>, 64>	counts{};
+	atomic<unsigned long long>		total{ 0 };
+	atomic<unsigned long long>		worst{ 0 };
+	atomic<unsigned long long>		pops{ 0 };
+
+public:
+	void pushed(size_t priority) { counts[priority].fetch_add(1, memory_order_relaxed); }
+	void popped(size_t priority) {
+		counts[priority].fetch_sub(1, memory_order_relaxed);
+		long long better = 0;
+		for (size_t p = 0; p < priority; ++p)
+			better += counts[p].load(memory_order_relaxed);
+		auto const rank = static_cast<unsigned long long>(max(better, 0LL));
+		total.fetch_add(rank, memory_order_relaxed);
+		for (auto seen = worst.load(memory_order_relaxed); rank > seen && !worst.compare_exchange_weak(seen, rank);)
+			;
+		pops.fetch_add(1, memory_order_relaxed);
+	}
+	double mean() const { return pops.load() == 0 ? 0.0 : double(total.load()) / double(pops.load()); }
+	double max_rank() const { return double(worst.load()); }
+};
+
+
+// State shared by the threads of a run, created by Setup before they start and released by Teardown.
+template <class QUEUE> unique_ptr<QUEUE> shared_queue;
+unique_ptr<rank_tracker> shared_ranks;
+
+template <class QUEUE>
+void CreateQueue(benchmark::State const& state) {
+	shared_queue<QUEUE> = make_shared_queue<QUEUE>(state.threads(), static_cast<size_t>(state.range(0)));
+}
+
+// Adds a standing backlog of 4096 elements, recorded in a fresh rank tracker.
+template <class QUEUE>
+void CreateBackloggedQueue(benchmark::State const& state) {
+	CreateQueue<QUEUE>(state);
+	shared_ranks = make_unique<rank_tracker>();
+	worker<QUEUE> filler{ *shared_queue<QUEUE>, 0 };
+	for (auto p : make_priorities(4096, 64, false)) {
+		shared_ranks->pushed(p);
+		filler.push(static_cast<int>(p), p);
+	}
+}
+
+template <class QUEUE>
+void DestroyQueue(benchmark::State const&) {
+	shared_queue<QUEUE>.reset();
+	shared_ranks.reset();
+}
+
+
+// Producer-consumer throughput: every thread pushes a batch and pops as many elements again.
+template <class QUEUE>
+void BM_Throughput(benchmark::State& state) {
+	auto const priorities = make_priorities(64, 64, false);
+	worker<QUEUE> self{ *shared_queue<QUEUE>, static_cast<size_t>(state.thread_index()) };
+
+	for (auto _ : state) {
+		for (auto p : priorities)
+			self.push(static_cast<int>(p), p);
+		int value;
+		for (size_t i = 0; i < priorities.size(); ++i)
+			benchmark::DoNotOptimize(self.pop(value));
+	}
+	state.SetItemsProcessed(state.iterations() * priorities.size());
+}
+
+
+// A single producer: only thread 0 pushes, into its own shard for the sharded queue, so every pop by another
+// thread is a steal. The producer tops the queue up to a bounded backlog and every thread makes a fixed number
+// of pop attempts per iteration; items are the elements popped, and the stolen rate counts those popped by
+// threads other than the producer.
+template <class QUEUE>
+void BM_Imbalanced(benchmark::State& state) {
+	auto const priorities = make_priorities(64, 64, false);
+	auto& queue = *shared_queue<QUEUE>;
+	worker<QUEUE> self{ queue, static_cast<size_t>(state.thread_index()) };
+	bool const producer = state.thread_index() == 0;
+	size_t const backlog = priorities.size() * static_cast<size_t>(state.threads());
+
+	int64_t popped = 0;
+	for (auto _ : state) {
+		if (producer && queue.size() < backlog)
+			for (auto p : priorities)
+				self.push(static_cast<int>(p), p);
+		int value;
+		for (auto i = 0; i < 8; ++i)
+			popped += self.pop(value);
+	}
+	state.SetItemsProcessed(popped);
+	state.counters["stolen"] = benchmark::Counter(producer ? 0.0 : double(popped), benchmark::Counter::kIsRate);
+}
+
+
+// Pop-push pairs over the standing backlog, reporting the mean and maximum rank error of the pops as
+// counters next to the throughput.
+template <class QUEUE>
+void BM_RankError(benchmark::State& state) {
+	auto const priorities = make_priorities(4096, 64, false);
+	worker<QUEUE> self{ *shared_queue<QUEUE>, static_cast<size_t>(state.thread_index()) };
+	auto& ranks = *shared_ranks;
+
+	size_t next = static_cast<size_t>(state.thread_index()) * 97;
+	for (auto _ : state) {
+		int value;
+		if (self.pop(value))
+			ranks.popped(static_cast<size_t>(value));
+		size_t const p = priorities[next++ % priorities.size()];
+		ranks.pushed(p);
+		self.push(static_cast<int>(p), p);
+	}
+	state.SetItemsProcessed(state.iterations());
+
+	// every thread has left the loop here; counters are summed over threads, so only one reports them
+	if (state.thread_index() == 0) {
+		state.counters["rank_error_mean"] = ranks.mean();
+		state.counters["rank_error_max"] = ranks.max_rank();
+	}
+}
+
+
+// Producers on adjacent levels: thread i only pushes to level i, so any slowdown as threads are added comes
+// from level metadata sharing cache lines rather than from contention on a level. Iterations are fixed to
+// bound the memory the queue grows to.
+template <class QUEUE>
+void BM_AdjacentLevels(benchmark::State& state) {
+	auto& queue = *shared_queue<QUEUE>;
+	auto const priority = static_cast<size_t>(state.thread_index());
+	for (auto _ : state)
+		queue.push(static_cast<int>(priority), priority);
+	state.SetItemsProcessed(state.iterations());
+}
+
+
+#define CONCURRENT_BENCHMARKS(QUEUE, ...)														\
+	BENCHMARK_TEMPLATE(BM_Throughput, QUEUE)->ArgsProduct({ __VA_ARGS__ })->ThreadRange(1, 32)->UseRealTime()		\
+		->Setup(CreateQueue<QUEUE>)->Teardown(DestroyQueue<QUEUE>);								\
+	BENCHMARK_TEMPLATE(BM_Imbalanced, QUEUE)->ArgsProduct({ __VA_ARGS__ })->ThreadRange(2, 32)->UseRealTime()		\
+		->Setup(CreateQueue<QUEUE>)->Teardown(DestroyQueue<QUEUE>);								\
+	BENCHMARK_TEMPLATE(BM_RankError, QUEUE)->ArgsProduct({ __VA_ARGS__ })->ThreadRange(1, 32)->UseRealTime()		\
+		->Setup(CreateBackloggedQueue<QUEUE>)->Teardown(DestroyQueue<QUEUE>)
+
+CONCURRENT_BENCHMARKS(concurrent_fixed_priority_multi_queue<int>, { 0 });
+CONCURRENT_BENCHMARKS(sharded_multi_queue<int>, { 0, 8 });
+CONCURRENT_BENCHMARKS(relaxed_multi_queue<int>, { 2, 4 });
+
+#define LAYOUT_BENCHMARKS(QUEUE)																\
+	BENCHMARK_TEMPLATE(BM_AdjacentLevels, QUEUE)->Arg(0)->ThreadRange(1, 32)->Iterations(1 << 18)->UseRealTime()	\
+		->Setup(CreateQueue<QUEUE>)->Teardown(DestroyQueue<QUEUE>)
+
+LAYOUT_BENCHMARKS(concurrent_fixed_priority_multi_queue<int>);
+LAYOUT_BENCHMARKS(padded_concurrent_fixed_priority_multi_queue<int>);
+
+
+// Round trip through an echo thread: two hand-offs from a waiting consumer per iteration, so the time is
+// twice the wake-up latency of the wait strategy plus the queue operations.
+template <class WAIT>
+void BM_WakeLatency(benchmark::State& state) {
+	using queue_type = concurrent_fixed_priority_multi_queue<int, ring_buffer<int>, packed_levels, WAIT>;
+	queue_type requests(8), replies(8);
+	thread echo([&] {
+		int value;
+		while (requests.wait_pop(value))
+			replies.push(value, 0);
+	});
+
+	int value = 0;
+	for (auto _ : state) {
+		requests.push(value, 0);
+		replies.wait_pop(value);
+	}
+	requests.close();
+	echo.join();
+}
+
+BENCHMARK_TEMPLATE(BM_WakeLatency, condition_wait)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WakeLatency, busy_spin_wait)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WakeLatency, spin_yield_wait<>)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WakeLatency, futex_wait<>)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -7,13 +7,278 @@
 	fixed_priority_multi_queue template class.
 */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <ostream>
 #include <queue>
+#include <scoped_allocator>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
+#if defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+
+// Alignment used to keep independently written atomics off each other's cache lines.
+constexpr std::size_t cache_line_size = 64;
+
+
+
+// Index of the lowest set bit of a non-zero word.
+inline unsigned count_trailing_zeros(std::uint64_t word) noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+		return static_cast<unsigned>(index);
+	_BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+	return static_cast<unsigned>(index) + 32;
+#else
+	return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+}
+
+
+
+// Index of the highest set bit of a non-zero word.
+inline unsigned highest_set_bit(std::uint64_t word) noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long index;
+	_BitScanReverse64(&index, word);
+	return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanReverse(&index, static_cast<unsigned long>(word >> 32)))
+		return static_cast<unsigned>(index) + 32;
+	_BitScanReverse(&index, static_cast<unsigned long>(word));
+	return static_cast<unsigned>(index);
+#else
+	return 63u - static_cast<unsigned>(__builtin_clzll(word));
+#endif
+}
+
+
+
+// Hint to the processor that the calling thread is spinning on a shared location.
+inline void cpu_relax() noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_pause();
+#elif defined(_MSC_VER) && (defined(_M_ARM) || defined(_M_ARM64))
+	__yield();
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+
+
+/*!	Hierarchical occupancy bitmap.
+
+	Layer 0 holds one bit per priority level, every layer above holds one bit per non-zero word of the layer
+	below, and the top layer is a single summary word. Finding the first set bit is one count-trailing-zeros
+	per layer, so it is constant time for up to 64^2 levels and grows by one step per factor of 64 after that.
+*/
+class occupancy_bitmap {
+
+	// TYPES
+public:
+	using size_type = std::size_t;
+	using word_type = std::uint64_t;
+	static constexpr size_type npos = static_cast<size_type>(-1);
+	static constexpr size_type bits_per_word = 64;
+
+	// ATTRIBUTES
+private:
+	std::vector<std::vector<word_type>>	layers;
+	size_type							nBits = 0;
+
+	// OPERATIONS
+public:
+	// constructors
+	~occupancy_bitmap() = default;
+	occupancy_bitmap() = default;
+	occupancy_bitmap(occupancy_bitmap const& other) = default;
+	occupancy_bitmap(occupancy_bitmap && other) noexcept
+		: layers(std::move(other.layers)), nBits(other.nBits) { other.clear(); }
+
+	// member operators
+	occupancy_bitmap& operator = (occupancy_bitmap const& other) = default;
+	occupancy_bitmap& operator = (occupancy_bitmap && other) noexcept {
+		layers = std::move(other.layers);
+		nBits = other.nBits;
+		other.clear();
+		return *this;
+	}
+
+	// capacity
+	size_type size() const noexcept { return nBits; }
+	bool none() const noexcept { return layers.empty() || layers.back().front() == 0; }
+
+	// element access
+	bool test(size_type bit) const noexcept {
+		return (layers[0][bit / bits_per_word] >> (bit % bits_per_word)) & 1u;
+	}
+	size_type find_first() const noexcept;
+	size_type find_next(size_type from) const noexcept;
+
+	// modifiers
+	void resize(size_type bits);
+	void shrink(size_type bits);
+	void set(size_type bit) noexcept;
+	void reset(size_type bit) noexcept;
+	void clear() noexcept { layers.clear(); nBits = 0; }
+	void swap(occupancy_bitmap& other) noexcept {
+		std::swap(layers, other.layers);
+		std::swap(nBits, other.nBits);
+	}
+};
+
+
+/*!	Thread-safe two-layer occupancy bitmap for a fixed number of levels.
+
+	Bits may be set and reset concurrently; once every writer has returned, a level's bit is set exactly when
+	it was last set() and not reset() since. find_next() never misses a bit whose set() finished before the call,
+	at the cost of scanning the words when the summary shows nothing. Readers still treat the result as a hint and
+	confirm under the level lock.
+*/
+class atomic_occupancy_bitmap {
+
+	// TYPES
+public:
+	using size_type = std::size_t;
+	using word_type = std::uint64_t;
+	static constexpr size_type npos = occupancy_bitmap::npos;
+	static constexpr size_type bits_per_word = occupancy_bitmap::bits_per_word;
+
+	// ATTRIBUTES
+private:
+	size_type									nWords;
+	size_type									nSummaryWords;
+	std::unique_ptr<std::atomic<word_type>[]>	words;
+	std::unique_ptr<std::atomic<word_type>[]>	summary;
+
+	// OPERATIONS
+public:
+	// constructors
+	explicit atomic_occupancy_bitmap(size_type bits);
+	atomic_occupancy_bitmap(atomic_occupancy_bitmap const&) = delete;
+	atomic_occupancy_bitmap& operator = (atomic_occupancy_bitmap const&) = delete;
+
+	// element access
+	bool test(size_type bit) const noexcept {
+		return (words[bit / bits_per_word].load() >> (bit % bits_per_word)) & 1u;
+	}
+	size_type find_first() const noexcept { return find_next(0); }
+	size_type find_next(size_type from) const noexcept;
+
+	// modifiers
+	void set(size_type bit) noexcept;
+	void reset(size_type bit) noexcept;
+};
+
+
+
+/*!	Bounded lock-free multi-producer/multi-consumer FIFO.
+
+	Every cell carries a sequence number that tells producers and consumers whose turn it is, so neither side
+	ever waits for the other; try_push() fails when the ring is full and try_pop() when it is empty.
+	The capacity is rounded up to a power of two.
+
+	A claimed cell must be published, so nothing may throw between claiming it and releasing it: elements must
+	move without throwing, and try_push() makes any copy or conversion that might throw before claiming a cell.
+*/
 template <class ELEMENT_T>
-class fixed_priority_multi_queue {
+class bounded_mpmc_ring {
+	static_assert(std::is_nothrow_move_constructible<ELEMENT_T>::value && std::is_nothrow_move_assignable<ELEMENT_T>::value,
+		"bounded_mpmc_ring elements must move without throwing");
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+
+private:
+	struct cell {
+		std::atomic<size_type>							sequence;
+		alignas(ELEMENT_T) unsigned char				storage[sizeof(ELEMENT_T)];
+	};
+
+	// ATTRIBUTES
+private:
+	size_type											mask;
+	std::unique_ptr<cell[]>								cells;
+	alignas(cache_line_size) std::atomic<size_type>		enqueuePos{ 0 };
+	alignas(cache_line_size) std::atomic<size_type>		dequeuePos{ 0 };
+
+	// OPERATIONS
+public:
+	// constructors
+	~bounded_mpmc_ring();
+	explicit bounded_mpmc_ring(size_type capacity);
+	bounded_mpmc_ring(bounded_mpmc_ring const&) = delete;
+	bounded_mpmc_ring& operator = (bounded_mpmc_ring const&) = delete;
+
+	// capacity
+	bool empty() const noexcept { return dequeuePos.load() >= enqueuePos.load(); }
+	size_type capacity() const noexcept { return mask + 1; }
+
+	// modifiers
+	template <class VALUE>
+	bool try_push(VALUE&& value);
+	bool try_pop(value_type& value);
+};
+
+
+
+/*!	Growable FIFO ring buffer.
+
+	Elements live in one contiguous power-of-two allocation that doubles when full and is kept when the buffer
+	drains, so a level that repeatedly fills and empties stops allocating after its first peak.
+	Trivially copyable elements are relocated with memcpy on growth. ALLOCATOR_T follows the standard
+	allocator-aware container rules, so a ring_buffer can live in a std::pmr resource.
+*/
+template <class ELEMENT_T, class ALLOCATOR_T = std::allocator<ELEMENT_T>>
+class ring_buffer {
 
 	// TYPES
 public:
@@ -21,152 +286,5062 @@ public:
 	using size_type = std::size_t;
 	using reference = value_type & ;
 	using const_reference = const value_type&;
+	using allocator_type = ALLOCATOR_T;
+
+private:
+	using alloc_traits = std::allocator_traits<allocator_type>;
+	static constexpr size_type initial_capacity = 8;
 
 	// ATTRIBUTES
 private:
-	std::vector<std::queue<ELEMENT_T>>	queues;
+	allocator_type	alloc;
+	ELEMENT_T*		buffer = nullptr;
+	size_type		nCapacity = 0;
+	size_type		head = 0;
+	size_type		nElements = 0;
 
 	// OPERATIONS
 public:
 	// constructors
-	~fixed_priority_multi_queue() = default;
-	fixed_priority_multi_queue() = default;
-	fixed_priority_multi_queue(fixed_priority_multi_queue const& other) = default;
-	fixed_priority_multi_queue(fixed_priority_multi_queue && other) noexcept : queues(move(other.queues)) {}
-	template <class FORWARD>
-	fixed_priority_multi_queue(FORWARD first, FORWARD last);
+	~ring_buffer();
+	ring_buffer() noexcept(noexcept(allocator_type())) : alloc() {}
+	explicit ring_buffer(allocator_type const& alloc) noexcept : alloc(alloc) {}
+	ring_buffer(ring_buffer const& other)
+		: ring_buffer(other, alloc_traits::select_on_container_copy_construction(other.alloc)) {}
+	ring_buffer(ring_buffer const& other, allocator_type const& alloc);
+	ring_buffer(ring_buffer && other) noexcept : alloc(other.alloc) { steal(other); }
+	ring_buffer(ring_buffer && other, allocator_type const& alloc);
 
 	// member operators
-	fixed_priority_multi_queue& operator = (fixed_priority_multi_queue const& other);
-	fixed_priority_multi_queue& operator = (fixed_priority_multi_queue && other) noexcept;
+	ring_buffer& operator = (ring_buffer const& other);
+	ring_buffer& operator = (ring_buffer && other)
+		noexcept(alloc_traits::propagate_on_container_move_assignment::value || alloc_traits::is_always_equal::value);
+
+	allocator_type get_allocator() const noexcept { return alloc; }
 
 	// element access
-	reference top() noexcept;
-	const_reference top() const noexcept;
+	reference front() noexcept { return buffer[head]; }
+	const_reference front() const noexcept { return buffer[head]; }
+	reference back() noexcept { return buffer[(head + nElements - 1) & (nCapacity - 1)]; }
+	const_reference back() const noexcept { return buffer[(head + nElements - 1) & (nCapacity - 1)]; }
 
 	// capacity
-	bool empty() const noexcept { return size() == 0; }
-	size_type size() const noexcept;
-	size_type max_priority() const noexcept { return queues.size(); }
+	bool empty() const noexcept { return nElements == 0; }
+	size_type size() const noexcept { return nElements; }
+	size_type capacity() const noexcept { return nCapacity; }
+	void reserve(size_type capacity);
+	void shrink_to_fit();
+
+	// bulk access
+	template <class FUNCTION>
+	void for_each_span(FUNCTION f) const;
 
 	// modifiers
-	void push(value_type const& value, size_type priority);
-	void push(value_type && value, size_type priority);
+	void push(value_type const& value) { emplace(value); }
+	void push(value_type && value) { emplace(std::move(value)); }
+	template <class... ARGS>
+	reference emplace(ARGS&&... args);
+	template <class FORWARD>
+	void append(FORWARD first, FORWARD last);
+	void splice(ring_buffer& other);
 	void pop() noexcept;
-	void swap(fixed_priority_multi_queue& other) noexcept;
+	void clear() noexcept;
+	void swap(ring_buffer& other) noexcept;
+
+private:
+	void relocate(ELEMENT_T* target);
+	void steal(ring_buffer& other) noexcept;
+	void release() noexcept;
 };
 
 
 
 // Helper functions
-template <class ELEMENT_T>
-inline void swap(fixed_priority_multi_queue<ELEMENT_T>& lhs, fixed_priority_multi_queue<ELEMENT_T>& rhs) noexcept {
+template <class ELEMENT_T, class ALLOCATOR_T>
+inline void swap(ring_buffer<ELEMENT_T, ALLOCATOR_T>& lhs, ring_buffer<ELEMENT_T, ALLOCATOR_T>& rhs) noexcept {
 	lhs.swap(rhs);
 }
 
-// =============================================================================================================
-// IMPLEMENTATIONS
-// =============================================================================================================
 
 
-// fixed_priority_multi_queue<ELEMENT_T>::fixed_priority_multi_queue(FORWARD beg, FORWARD end)
-template <class ELEMENT_T>
-template <class FORWARD>
-fixed_priority_multi_queue<ELEMENT_T>::fixed_priority_multi_queue(FORWARD beg, FORWARD end) {
-	while (beg != end) {
-		push(beg->first, beg->second);
-		++beg;
+/*!	Fixed-size block of consecutive FIFO slots, linked into a chunked_queue.
+
+	Live elements occupy slots [first, last); a chunk is only appended to while it is a queue's tail.
+*/
+template <class ELEMENT_T, std::size_t CHUNK_SIZE>
+struct queue_chunk {
+	static constexpr std::size_t capacity = CHUNK_SIZE;
+
+	queue_chunk*	next = nullptr;
+	std::size_t		first = 0;
+	std::size_t		last = 0;
+	alignas(ELEMENT_T) unsigned char storage[CHUNK_SIZE * sizeof(ELEMENT_T)];
+
+	ELEMENT_T* slot(std::size_t index) noexcept { return reinterpret_cast<ELEMENT_T*>(storage) + index; }
+	ELEMENT_T const* slot(std::size_t index) const noexcept { return reinterpret_cast<ELEMENT_T const*>(storage) + index; }
+};
+
+
+
+/*!	Intrusive free list of raw blocks sized for one CHUNK_T.
+
+	Released blocks are threaded through their own storage and handed out again before any new block is taken
+	from the heap; blocks only return to the heap when the pool is destroyed.
+*/
+template <class CHUNK_T>
+class chunk_pool {
+
+	// TYPES
+public:
+	using size_type = std::size_t;
+
+private:
+	struct free_block {
+		free_block* next;
+	};
+	static_assert(sizeof(CHUNK_T) >= sizeof(free_block), "chunk too small to hold a free-list link");
+
+	// ATTRIBUTES
+private:
+	free_block*	freeList = nullptr;
+	size_type	nFree = 0;
+	size_type	nAllocated = 0;
+
+	// OPERATIONS
+public:
+	// constructors
+	~chunk_pool();
+	chunk_pool() = default;
+	chunk_pool(chunk_pool const&) = delete;
+	chunk_pool& operator = (chunk_pool const&) = delete;
+
+	// capacity
+	size_type free_chunks() const noexcept { return nFree; }
+	size_type allocated_chunks() const noexcept { return nAllocated; }
+	void reserve(size_type chunks);
+	void trim() noexcept;
+
+	// modifiers
+	void* acquire();
+	void release(void* block) noexcept;
+
+private:
+	static void* allocate_block() { return ::operator new(sizeof(CHUNK_T), std::align_val_t(alignof(CHUNK_T))); }
+};
+
+
+
+/*!	Allocator whose single-chunk allocations are served from a shared chunk_pool.
+
+	A default-constructed allocator creates a new pool and every copy or rebind shares it, so all levels of one
+	multi-queue recycle each other's chunks. Copying a container selects a fresh pool. Any other allocation goes
+	straight to operator new.
+*/
+template <class ELEMENT_T, class CHUNK_T>
+class pool_allocator {
+	template <class, class> friend class pool_allocator;
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using pool_type = chunk_pool<CHUNK_T>;
+	using propagate_on_container_copy_assignment = std::false_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+	using is_always_equal = std::false_type;
+
+	template <class OTHER_T>
+	struct rebind {
+		using other = pool_allocator<OTHER_T, CHUNK_T>;
+	};
+
+	// ATTRIBUTES
+private:
+	std::shared_ptr<pool_type>	pool;
+
+	// OPERATIONS
+public:
+	// constructors
+	pool_allocator() : pool(std::make_shared<pool_type>()) {}
+	template <class OTHER_T>
+	pool_allocator(pool_allocator<OTHER_T, CHUNK_T> const& other) noexcept : pool(other.pool) {}
+
+	pool_allocator select_on_container_copy_construction() const { return pool_allocator(); }
+
+	// allocation
+	ELEMENT_T* allocate(size_type n);
+	void deallocate(ELEMENT_T* p, size_type n) noexcept;
+
+	// pool
+	pool_type& resource() const noexcept { return *pool; }
+	void reserve(size_type elements, size_type levels) {
+		pool->reserve((elements + CHUNK_T::capacity - 1) / CHUNK_T::capacity + levels);
 	}
-}
+	void trim() noexcept { pool->trim(); }
 
+	template <class OTHER_T>
+	bool operator == (pool_allocator<OTHER_T, CHUNK_T> const& other) const noexcept { return pool == other.pool; }
+	template <class OTHER_T>
+	bool operator != (pool_allocator<OTHER_T, CHUNK_T> const& other) const noexcept { return pool != other.pool; }
+};
 
 
-// fixed_priority_multi_queue<ELEMENT_T>::pop()
-template <class ELEMENT_T>
-void fixed_priority_multi_queue<ELEMENT_T>::pop() noexcept {
-	auto qptr = queues.begin();
-	while (qptr != queues.end() && qptr->empty())
-		++qptr;
-	return qptr->pop();
-}
 
+/*!	FIFO of linked fixed-size chunks.
 
+	Drained chunks go back to the allocator as soon as the head moves past them, except the last one, which
+	is kept for the next push. Paired with pool_allocator, a queue in steady state never touches the heap.
+*/
+template <class ELEMENT_T, class ALLOCATOR_T = std::allocator<ELEMENT_T>, std::size_t CHUNK_SIZE = 32>
+class chunked_queue {
 
-// L-value fixed_priority_multi_queue<ELEMENT_T>::push()
-template <class ELEMENT_T>
-void fixed_priority_multi_queue<ELEMENT_T>::push(value_type const& value, size_type priority) {
-	if (priority >= queues.size())
-		queues.resize(priority + 1);
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using reference = value_type & ;
+	using const_reference = const value_type&;
+	using allocator_type = ALLOCATOR_T;
+	using chunk_type = queue_chunk<ELEMENT_T, CHUNK_SIZE>;
 
-	queues[priority].push(value);
-}
+private:
+	using alloc_traits = std::allocator_traits<allocator_type>;
+	using chunk_allocator_type = typename alloc_traits::template rebind_alloc<chunk_type>;
+	using chunk_traits = std::allocator_traits<chunk_allocator_type>;
 
+	// ATTRIBUTES
+private:
+	chunk_allocator_type	alloc;
+	chunk_type*				head = nullptr;
+	chunk_type*				tail = nullptr;
+	size_type				nElements = 0;
 
+	// OPERATIONS
+public:
+	// constructors
+	~chunked_queue();
+	chunked_queue() : alloc() {}
+	explicit chunked_queue(allocator_type const& alloc) noexcept : alloc(alloc) {}
+	chunked_queue(chunked_queue const& other)
+		: chunked_queue(other, chunk_traits::select_on_container_copy_construction(other.alloc)) {}
+	chunked_queue(chunked_queue const& other, allocator_type const& alloc);
+	chunked_queue(chunked_queue && other) noexcept : alloc(other.alloc) { steal(other); }
+	chunked_queue(chunked_queue && other, allocator_type const& alloc);
 
-// R-value fixed_priority_multi_queue<ELEMENT_T>::push()
-template <class ELEMENT_T>
-void fixed_priority_multi_queue<ELEMENT_T>::push(value_type && value, size_type priority) {
-	if (priority >= queues.size())
-		queues.resize(priority + 1);
+	// member operators
+	chunked_queue& operator = (chunked_queue const& other);
+	chunked_queue& operator = (chunked_queue && other)
+		noexcept(chunk_traits::propagate_on_container_move_assignment::value || chunk_traits::is_always_equal::value);
 
-	queues[priority].push(std::move(value));
-}
+	allocator_type get_allocator() const noexcept { return allocator_type(alloc); }
+
+	// element access
+	reference front() noexcept { return *head->slot(head->first); }
+	const_reference front() const noexcept { return *head->slot(head->first); }
+	reference back() noexcept { return *tail->slot(tail->last - 1); }
+	const_reference back() const noexcept { return *tail->slot(tail->last - 1); }
 
+	// capacity
+	bool empty() const noexcept { return nElements == 0; }
+	size_type size() const noexcept { return nElements; }
+	void shrink_to_fit() noexcept {
+		if (nElements == 0)
+			release();	// the chunk kept for the next push
+	}
 
+	// bulk access
+	template <class FUNCTION>
+	void for_each_span(FUNCTION f) const;
+
+	// modifiers
+	void push(value_type const& value) { emplace(value); }
+	void push(value_type && value) { emplace(std::move(value)); }
+	template <class... ARGS>
+	reference emplace(ARGS&&... args);
+	void splice(chunked_queue& other);
+	void pop() noexcept;
+	void clear() noexcept;
+	void swap(chunked_queue& other) noexcept;
+
+private:
+	chunk_type* new_chunk();
+	void delete_chunk(chunk_type* chunk) noexcept;
+	void steal(chunked_queue& other) noexcept;
+	void release() noexcept;
+	void append_from(chunked_queue& other);
+};
 
-// fixed_priority_multi_queue<ELEMENT_T>::size()
-template <class ELEMENT_T>
-typename fixed_priority_multi_queue<ELEMENT_T>::size_type fixed_priority_multi_queue<ELEMENT_T>::size() const noexcept {
-	size_type nElements = 0;
-	for (auto const& q : queues)
-		nElements += q.size();
 
-	return nElements;
+
+// Helper functions
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+inline void swap(chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>& lhs, chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>& rhs) noexcept {
+	lhs.swap(rhs);
 }
 
+// Level container of the node-pool mode: chunks recycled through one pool per multi-queue.
+template <class ELEMENT_T, std::size_t CHUNK_SIZE = 32>
+using pooled_chunked_queue = chunked_queue<ELEMENT_T, pool_allocator<ELEMENT_T, queue_chunk<ELEMENT_T, CHUNK_SIZE>>, CHUNK_SIZE>;
+
 
 
-// fixed_priority_multi_queue<ELEMENT_T>::top()
+/*!	Node of a linked_queue: one element between the links to its neighbours.
+
+	tag is a word for the queue's owner; fixed_priority_multi_queue keeps the element's priority there.
+*/
 template <class ELEMENT_T>
-typename fixed_priority_multi_queue<ELEMENT_T>::reference fixed_priority_multi_queue<ELEMENT_T>::top() noexcept {
-	auto qptr = queues.begin();
-	while (qptr != queues.end() && qptr->empty())
-		++qptr;
-	return qptr->front();
-}
+struct queue_node {
+	queue_node*		prev = nullptr;
+	queue_node*		next = nullptr;
+	std::size_t		tag = 0;
+	alignas(ELEMENT_T) unsigned char storage[sizeof(ELEMENT_T)];
+
+	ELEMENT_T* value() noexcept { return reinterpret_cast<ELEMENT_T*>(storage); }
+	ELEMENT_T const* value() const noexcept { return reinterpret_cast<ELEMENT_T const*>(storage); }
+};
+
 
 
+/*!	Handle to an element of a linked_queue, valid until the element is popped or erased.
 
-// fixed_priority_multi_queue<ELEMENT_T>::top()
+	Dereferences to the element. A default-constructed handle refers to nothing.
+*/
 template <class ELEMENT_T>
-typename fixed_priority_multi_queue<ELEMENT_T>::const_reference fixed_priority_multi_queue<ELEMENT_T>::top() const noexcept {
-	auto qptr = queues.begin();
-	while (qptr != queues.end() && qptr->empty())
-		++qptr;
-	return qptr->front();
-}
+class queue_handle {
+	template <class, class> friend class linked_queue;
 
+	// ATTRIBUTES
+private:
+	queue_node<ELEMENT_T>*	node = nullptr;
 
+	// OPERATIONS
+public:
+	queue_handle() noexcept = default;
 
-// fixed_priority_multi_queue::operator = (copy)
-template <class Key>
-fixed_priority_multi_queue<Key>& fixed_priority_multi_queue<Key>::operator = (fixed_priority_multi_queue<Key> const& other) {
-	queues = other.queues;
-	return *this;
-}
+	ELEMENT_T& operator * () const noexcept { return *node->value(); }
+	ELEMENT_T* operator -> () const noexcept { return node->value(); }
+	explicit operator bool () const noexcept { return node != nullptr; }
+	bool operator == (queue_handle const& other) const noexcept { return node == other.node; }
+	bool operator != (queue_handle const& other) const noexcept { return node != other.node; }
 
+private:
+	explicit queue_handle(queue_node<ELEMENT_T>* node) noexcept : node(node) {}
+};
 
 
-// fixed_priority_multi_queue::operator = (move)
-template <class Key>
-fixed_priority_multi_queue<Key>& fixed_priority_multi_queue<Key>::operator = (fixed_priority_multi_queue<Key> && other) noexcept {
-	queues = std::move(other.queues);
-	return *this;
-}
 
+/*!	FIFO of individually allocated, doubly linked nodes.
 
-//Swap method implementation
-template <class Key>
-inline void fixed_priority_multi_queue<Key>::swap(fixed_priority_multi_queue& other) noexcept {
-	std::swap(queues, other.queues);
+	Slower to push and pop than ring_buffer or chunked_queue, but every element has a stable address: a handle
+	from emplace_tracked() can erase its element from the middle of the queue, or relink it to the back of
+	another queue sharing the allocator, in constant time.
+*/
+template <class ELEMENT_T, class ALLOCATOR_T = std::allocator<ELEMENT_T>>
+class linked_queue {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using reference = value_type & ;
+	using const_reference = const value_type&;
+	using allocator_type = ALLOCATOR_T;
+	using node_type = queue_node<ELEMENT_T>;
+	using handle = queue_handle<ELEMENT_T>;
+
+private:
+	using alloc_traits = std::allocator_traits<allocator_type>;
+	using node_allocator_type = typename alloc_traits::template rebind_alloc<node_type>;
+	using node_traits = std::allocator_traits<node_allocator_type>;
+
+	// ATTRIBUTES
+private:
+	node_allocator_type	alloc;
+	node_type*			head = nullptr;
+	node_type*			tail = nullptr;
+	size_type			nElements = 0;
+
+	// OPERATIONS
+public:
+	// constructors
+	~linked_queue() { clear(); }
+	linked_queue() : alloc() {}
+	explicit linked_queue(allocator_type const& alloc) noexcept : alloc(alloc) {}
+	linked_queue(linked_queue const& other)
+		: linked_queue(other, node_traits::select_on_container_copy_construction(other.alloc)) {}
+	linked_queue(linked_queue const& other, allocator_type const& alloc);
+	linked_queue(linked_queue && other) noexcept : alloc(other.alloc) { steal(other); }
+	linked_queue(linked_queue && other, allocator_type const& alloc);
+
+	// member operators
+	linked_queue& operator = (linked_queue const& other);
+	linked_queue& operator = (linked_queue && other)
+		noexcept(node_traits::propagate_on_container_move_assignment::value || node_traits::is_always_equal::value);
+
+	allocator_type get_allocator() const noexcept { return allocator_type(alloc); }
+
+	// element access
+	reference front() noexcept { return *head->value(); }
+	const_reference front() const noexcept { return *head->value(); }
+	reference back() noexcept { return *tail->value(); }
+	const_reference back() const noexcept { return *tail->value(); }
+
+	// capacity
+	bool empty() const noexcept { return nElements == 0; }
+	size_type size() const noexcept { return nElements; }
+
+	// bulk access
+	template <class FUNCTION>
+	void for_each_span(FUNCTION f) const;
+
+	// handles
+	handle front_handle() const noexcept { return handle(head); }
+	static size_type& tag(handle h) noexcept { return h.node->tag; }
+
+	// modifiers
+	void push(value_type const& value) { emplace(value); }
+	void push(value_type && value) { emplace(std::move(value)); }
+	template <class... ARGS>
+	reference emplace(ARGS&&... args) { return *emplace_tracked(std::forward<ARGS>(args)...); }
+	template <class... ARGS>
+	handle emplace_tracked(ARGS&&... args);
+	void erase(handle h) noexcept;
+	void relink(handle h, linked_queue& target) noexcept;
+	void splice(linked_queue& other);
+	void pop() noexcept { erase(handle(head)); }
+	void clear() noexcept;
+	void swap(linked_queue& other) noexcept;
+
+private:
+	void link_back(node_type* node) noexcept;
+	void unlink(node_type* node) noexcept;
+	void steal(linked_queue& other) noexcept;
+	void copy_from(linked_queue const& other);
+	void append_from(linked_queue& other);
+};
+
+
+
+// Helper functions
+template <class ELEMENT_T, class ALLOCATOR_T>
+inline void swap(linked_queue<ELEMENT_T, ALLOCATOR_T>& lhs, linked_queue<ELEMENT_T, ALLOCATOR_T>& rhs) noexcept {
+	lhs.swap(rhs);
+}
+
+
+
+// Level containers that can reserve room for a known number of elements.
+template <class LEVEL_T, class = void>
+struct has_level_reserve : std::false_type {};
+
+template <class LEVEL_T>
+struct has_level_reserve<LEVEL_T, std::void_t<decltype(std::declval<LEVEL_T&>().reserve(std::size_t()))>>
+	: std::true_type {};
+
+// Allocators that can pre-warm storage for a number of elements spread over a number of levels.
+template <class ALLOCATOR_T, class = void>
+struct has_pool_reserve : std::false_type {};
+
+template <class ALLOCATOR_T>
+struct has_pool_reserve<ALLOCATOR_T, std::void_t<decltype(std::declval<ALLOCATOR_T&>().reserve(std::size_t(), std::size_t()))>>
+	: std::true_type {};
+
+
+
+// Level containers that can release unused storage.
+template <class LEVEL_T, class = void>
+struct has_level_shrink : std::false_type {};
+
+template <class LEVEL_T>
+struct has_level_shrink<LEVEL_T, std::void_t<decltype(std::declval<LEVEL_T&>().shrink_to_fit())>>
+	: std::true_type {};
+
+// Allocators that can hand their cached storage back to the system.
+template <class ALLOCATOR_T, class = void>
+struct has_pool_trim : std::false_type {};
+
+template <class ALLOCATOR_T>
+struct has_pool_trim<ALLOCATOR_T, std::void_t<decltype(std::declval<ALLOCATOR_T&>().trim())>>
+	: std::true_type {};
+
+
+
+// Level containers that hand out their elements as contiguous runs, front to back.
+template <class LEVEL_T, class = void>
+struct has_level_spans : std::false_type {};
+
+template <class LEVEL_T>
+struct has_level_spans<LEVEL_T, std::void_t<decltype(std::declval<LEVEL_T const&>().for_each_span(
+	std::declval<void (*)(typename LEVEL_T::value_type const*, std::size_t)>()))>>
+	: std::true_type {};
+
+// Level containers that can append a range of elements in bulk.
+template <class LEVEL_T, class = void>
+struct has_level_append : std::false_type {};
+
+template <class LEVEL_T>
+struct has_level_append<LEVEL_T, std::void_t<decltype(std::declval<LEVEL_T&>().append(
+	std::declval<typename LEVEL_T::value_type const*>(), std::declval<typename LEVEL_T::value_type const*>()))>>
+	: std::true_type {};
+
+
+
+// Level containers that can take over the elements of another level of the same type.
+template <class LEVEL_T, class = void>
+struct has_level_splice : std::false_type {};
+
+template <class LEVEL_T>
+struct has_level_splice<LEVEL_T, std::void_t<decltype(std::declval<LEVEL_T&>().splice(std::declval<LEVEL_T&>()))>>
+	: std::true_type {};
+
+
+
+// Level containers whose elements can be tracked by handle, and the handle type; other containers get a
+// placeholder that no operation accepts.
+template <class LEVEL_T, class = void>
+struct has_level_handles : std::false_type {};
+
+template <class LEVEL_T>
+struct has_level_handles<LEVEL_T, std::void_t<typename LEVEL_T::handle>> : std::true_type {};
+
+template <class LEVEL_T, class = void>
+struct level_handle {
+	struct type {};
+};
+
+template <class LEVEL_T>
+struct level_handle<LEVEL_T, std::void_t<typename LEVEL_T::handle>> {
+	using type = typename LEVEL_T::handle;
+};
+
+
+
+// Allocator of a level container: its own allocator_type, else that of the adapted container (std::queue).
+template <class LEVEL_T, class = void>
+struct level_allocator {
+	using type = typename LEVEL_T::container_type::allocator_type;
+};
+
+template <class LEVEL_T>
+struct level_allocator<LEVEL_T, std::void_t<typename LEVEL_T::allocator_type>> {
+	using type = typename LEVEL_T::allocator_type;
+};
+
+// Allocator that hands itself on to the elements it constructs; polymorphic_allocator already does so.
+template <class ALLOCATOR_T>
+struct scoped_allocator {
+	using type = std::scoped_allocator_adaptor<ALLOCATOR_T>;
+};
+
+template <class ELEMENT_T>
+struct scoped_allocator<std::pmr::polymorphic_allocator<ELEMENT_T>> {
+	using type = std::pmr::polymorphic_allocator<ELEMENT_T>;
+};
+
+
+
+/*!	Snapshot of a multi-queue's instrumentation, one entry per priority level.
+
+	sojourn holds one histogram per level when enqueue timestamps are recorded and is empty otherwise.
+	Bucket i counts the elements that waited [2^i, 2^(i+1)) nanoseconds; the last bucket also takes longer waits.
+*/
+struct multi_queue_stats {
+	static constexpr std::size_t sojourn_buckets = 40;
+	using histogram = std::array<std::uint64_t, sojourn_buckets>;
+
+	struct level {
+		std::uint64_t	pushes = 0;
+		std::uint64_t	pops = 0;
+		std::uint64_t	promoted = 0;
+		std::size_t		max_depth = 0;
+		std::uint64_t	erased = 0;
+		std::uint64_t	moved = 0;
+	};
+
+	std::vector<level>		levels;
+	std::vector<histogram>	sojourn;
+};
+
+
+
+/*!	Stats policy that records nothing.
+
+	Every hook is an empty inline function and the policy is an empty base of the queue, so a queue built
+	with it has the same size and code as one without instrumentation.
+*/
+struct no_stats {
+	void on_grow(std::size_t) noexcept {}
+	void on_shrink(std::size_t) noexcept {}
+	void prepare_push(std::size_t) noexcept {}
+	void on_push(std::size_t, std::size_t) noexcept {}
+	void on_pop(std::size_t) noexcept {}
+	void prepare_transfer(std::size_t, std::size_t) noexcept {}
+	void on_transfer(std::size_t, std::size_t, std::size_t, std::size_t) noexcept {}
+	void prepare_splice(std::size_t, std::size_t) noexcept {}
+	void on_splice(no_stats&, std::size_t, std::size_t, std::size_t) noexcept {}
+	void on_erase(std::size_t) noexcept {}
+	void on_move(std::size_t) noexcept {}
+	void clear() noexcept {}
+	multi_queue_stats snapshot() const { return multi_queue_stats(); }
+};
+
+
+
+/*!	Stats policy recording push, pop and promotion counts and the high-water depth of every level.
+
+	With TIMESTAMPS each push also records its enqueue time in a FIFO that runs parallel to the level, and
+	each pop adds the time the element spent in the queue to that level's sojourn histogram. prepare_push()
+	makes room for the timestamp before the element is stored, so on_push() cannot fail after the level grew.
+	Promoted elements take their timestamps along, so their sojourn time covers every level they waited in.
+	Elements spliced in from another queue count as pushes here and bring their timestamps from its policy.
+	Erased elements are counted apart from pops. Their timestamps cannot be picked out of the middle of the
+	FIFO, so the level's oldest one is dropped instead: the elements ahead of an erased one report sojourn
+	times that are too short by at most the gap between their pushes. An element whose priority changes counts
+	as moved out of its old level, with its timestamp dropped the same way, and as a push at the new level,
+	where it is timed again from its arrival.
+	Counters outlive shrink_to_fit(), which only releases spare timestamp storage.
+*/
+template <bool TIMESTAMPS = false, class CLOCK = std::chrono::steady_clock>
+class level_stats {
+
+	// TYPES
+public:
+	using size_type = std::size_t;
+	using clock = CLOCK;
+
+private:
+	using time_point = typename CLOCK::time_point;
+
+	// ATTRIBUTES
+private:
+	std::vector<multi_queue_stats::level>		levels;
+	std::vector<multi_queue_stats::histogram>	sojourn;
+	std::vector<ring_buffer<time_point>>		enqueued;
+
+	// OPERATIONS
+public:
+	void on_grow(size_type levels);
+	void on_shrink(size_type levels);
+	void prepare_push(size_type priority);
+	void on_push(size_type priority, size_type depth) noexcept;
+	void on_pop(size_type priority) noexcept;
+	void prepare_transfer(size_type to, size_type count);
+	void on_transfer(size_type from, size_type to, size_type count, size_type depth) noexcept;
+	void prepare_splice(size_type priority, size_type count);
+	void on_splice(level_stats& source, size_type priority, size_type count, size_type depth) noexcept;
+	void on_erase(size_type priority) noexcept;
+	void on_move(size_type priority) noexcept;
+	void clear() noexcept;
+	multi_queue_stats snapshot() const;
+};
+
+
+
+/*!	Dequeue policy serving the lowest-index non-empty level first.
+
+	Like no_stats it is an empty base whose hooks compile away, leaving a single find_first() per dequeue.
+*/
+struct strict_priority {
+	void on_grow(std::size_t) noexcept {}
+	void on_shrink(std::size_t) noexcept {}
+	template <class LEVELS>
+	std::size_t select(occupancy_bitmap const& occupied, LEVELS const&) const noexcept { return occupied.find_first(); }
+	template <class ELEMENT_T>
+	void on_serve(std::size_t, ELEMENT_T const&) noexcept {}
+	void on_drain(std::size_t) noexcept {}
+	void clear() noexcept {}
+};
+
+
+
+// Element cost that charges every element one unit.
+struct unit_cost {
+	template <class ELEMENT_T>
+	std::size_t operator () (ELEMENT_T const&) const noexcept { return 1; }
+};
+
+
+
+/*!	Deficit round-robin dequeue policy.
+
+	Non-empty levels are visited cyclically in priority order. A visit adds the level's quantum to its deficit,
+	and the level is served while the cost of its front element (COST_T) fits in the deficit; a level that
+	drains forfeits what is left. The next level comes from find_next() on the occupancy bitmap, so selection is
+	constant time while no quantum is below the largest element cost. The round state is mutable: top() may
+	advance the round, and pop() then serves the level top() chose.
+*/
+template <class COST_T = unit_cost>
+class deficit_round_robin {
+
+	// TYPES
+public:
+	using size_type = std::size_t;
+	using cost_type = COST_T;
+
+private:
+	static constexpr size_type npos = occupancy_bitmap::npos;
+
+	// ATTRIBUTES
+private:
+	std::vector<size_type>			quanta;
+	size_type						defaultQuantum;
+	COST_T							cost;
+	mutable std::vector<size_type>	deficits;
+	mutable size_type				current = npos;
+
+	// OPERATIONS
+public:
+	explicit deficit_round_robin(std::vector<size_type> quanta = {}, size_type default_quantum = 1, COST_T cost = COST_T());
+
+	// configuration
+	size_type quantum(size_type priority) const noexcept { return priority < quanta.size() ? quanta[priority] : defaultQuantum; }
+	void set_quantum(size_type priority, size_type quantum);
+
+	// queue hooks
+	void on_grow(size_type levels);
+	void on_shrink(size_type levels);
+	template <class LEVELS>
+	size_type select(occupancy_bitmap const& occupied, LEVELS const& levels) const noexcept;
+	template <class ELEMENT_T>
+	void on_serve(size_type priority, ELEMENT_T const& element) noexcept;
+	void on_drain(size_type priority) noexcept { deficits[priority] = 0; }
+	void clear() noexcept;
+};
+
+
+
+// Weighted round-robin: a visit serves up to the level's weight (its quantum) in elements.
+using weighted_round_robin = deficit_round_robin<unit_cost>;
+
+
+
+/*!	Aging policy that never promotes; like no_stats its hooks compile away.
+*/
+struct no_aging {
+	void on_grow(std::size_t) noexcept {}
+	void on_shrink(std::size_t) noexcept {}
+	void prepare_push(std::size_t) noexcept {}
+	void on_push(std::size_t) noexcept {}
+	void on_pop(std::size_t) noexcept {}
+	std::pair<std::size_t, std::size_t> expired(occupancy_bitmap const&) noexcept { return { 0, 0 }; }
+	void prepare_transfer(std::size_t) noexcept {}
+	void on_transfer(std::size_t, std::size_t, std::size_t) noexcept {}
+	void prepare_splice(std::size_t, no_aging const&) noexcept {}
+	void on_splice(no_aging&, std::size_t, std::size_t) noexcept {}
+	void on_erase(std::size_t) noexcept {}
+	void clear() noexcept {}
+};
+
+
+
+// Clock for level_aging that measures age in dequeues from the queue rather than in time.
+struct dequeue_clock {
+	using duration = std::size_t;
+	using time_point = std::size_t;
+};
+
+
+
+/*!	Aging policy promoting elements that waited in level k longer than a threshold into level k-1.
+
+	Age is measured with CLOCK: dequeue_clock (the default) or a std::chrono clock. Pushes to a level are
+	tracked as runs, and a push within threshold/8 of the start of the level's newest run joins that run, so
+	an element may be promoted up to threshold/8 early. After each dequeue, expired() checks the oldest run of
+	one occupied level, rotating through the levels, and the queue moves an expired run to the back of the
+	level above, where it starts a new run. A dequeue moves at most promotion_limit elements; the rest of a
+	longer run follows on the next dequeues, which return to the same level first, so promotion adds bounded
+	work to any one pop. An element thus climbs a level per threshold plus at most one rotation and the
+	dequeues its run needs, and is moved at most once per level. An erased element is taken from the oldest run of its
+	level, so the element closing that run may be promoted with the next run instead.
+*/
+template <class CLOCK = dequeue_clock>
+class level_aging {
+
+	// TYPES
+public:
+	using size_type = std::size_t;
+	using clock = CLOCK;
+	using duration = typename CLOCK::duration;
+
+private:
+	using time_point = typename CLOCK::time_point;
+	static constexpr size_type npos = occupancy_bitmap::npos;
+
+	struct run {
+		time_point	since;
+		size_type	count;
+	};
+
+	// ATTRIBUTES
+private:
+	duration						threshold;
+	duration						granularity;
+	size_type						limit;
+	std::vector<ring_buffer<run>>	runs;
+	size_type						dequeues = 0;
+	size_type						cursor = 0;
+
+	// OPERATIONS
+public:
+	explicit level_aging(duration threshold, size_type promotion_limit = 64);
+
+	// configuration
+	duration age_threshold() const noexcept { return threshold; }
+	size_type promotion_limit() const noexcept { return limit; }
+
+	// queue hooks
+	void on_grow(size_type levels);
+	void on_shrink(size_type levels);
+	void prepare_push(size_type priority);
+	void on_push(size_type priority) noexcept;
+	void on_pop(size_type priority) noexcept;
+	std::pair<size_type, size_type> expired(occupancy_bitmap const& occupied) noexcept;
+	void prepare_transfer(size_type to);
+	void on_transfer(size_type from, size_type to, size_type count) noexcept;
+	void prepare_splice(size_type priority, level_aging const& source);
+	void on_splice(level_aging& source, size_type priority, size_type count) noexcept;
+	void on_erase(size_type priority) noexcept;
+	void clear() noexcept;
+
+private:
+	time_point now() const noexcept;
+};
+
+
+
+/*!	Trim policy that never shrinks on its own; shrink_to_fit() still releases memory on request.
+*/
+struct no_trim {
+	void on_push(std::size_t) noexcept {}
+	bool on_pop(std::size_t, std::size_t = 1) noexcept { return false; }
+	void clear() noexcept {}
+};
+
+
+
+/*!	Trim policy shrinking the queue once its load has stayed well below the peak its storage was sized for.
+
+	The queue size is tracked over windows of `window` dequeues. The storage is assumed to fit the highest size
+	seen since the last trim; when a whole window peaks at no more than 1/ratio of that mark, the queue calls
+	shrink_to_fit() and the window's peak becomes the new mark. The gap between the mark and the trim threshold
+	is the hysteresis: load that comes back within a window never triggers a trim, so bursts that recur do not
+	free and reallocate the same storage every time.
+*/
+class watermark_trim {
+
+	// TYPES
+public:
+	using size_type = std::size_t;
+
+	// ATTRIBUTES
+private:
+	size_type	window;
+	size_type	ratio;
+	size_type	mark = 0;
+	size_type	peak = 0;
+	size_type	dequeues = 0;
+
+	// OPERATIONS
+public:
+	explicit watermark_trim(size_type window = 4096, size_type ratio = 4);
+
+	// configuration
+	size_type trim_window() const noexcept { return window; }
+	size_type trim_ratio() const noexcept { return ratio; }
+
+	// queue hooks
+	void on_push(size_type size) noexcept { peak = std::max(peak, size); }
+	bool on_pop(size_type size, size_type count = 1) noexcept;
+	void clear() noexcept { mark = peak = dequeues = 0; }
+};
+
+
+
+/*!	Read-only view of a snapshot file written by fixed_priority_multi_queue::save().
+
+	The file starts with a header and a table giving the element count and byte offset of every level. The
+	levels follow as arrays of elements in FIFO order, each starting on a 64-byte boundary. Integers and
+	elements keep the writer's byte order and layout; the header records both, and a snapshot is only accepted
+	by the same element type on the same kind of host.
+
+	Where POSIX mmap is available the file is mapped rather than read: level_data() points into the page cache,
+	so levels can be consumed in place, and the fixed_priority_multi_queue constructor taking a snapshot restores
+	each level with one bulk copy. Elsewhere the file is read into memory once.
+*/
+template <class ELEMENT_T>
+class multi_queue_snapshot {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+
+	struct header {
+		std::uint64_t	signature;
+		std::uint32_t	version;
+		std::uint32_t	byte_order;
+		std::uint64_t	element_size;
+		std::uint64_t	element_align;
+		std::uint64_t	levels;
+		std::uint64_t	elements;
+	};
+
+	struct level_entry {
+		std::uint64_t	count;
+		std::uint64_t	offset;
+	};
+
+	static constexpr std::uint64_t format_signature = 0x485350414e53514dull;	// "MQSNAPSH"
+	static constexpr std::uint32_t format_version = 1;
+	static constexpr std::uint32_t byte_order_mark = 0x01020304;
+	static constexpr size_type alignment = 64;
+
+	// ATTRIBUTES
+private:
+	unsigned char const*				bytes = nullptr;
+	size_type							nBytes = 0;
+	std::unique_ptr<unsigned char[]>	contents;	// the file, when it is read rather than mapped
+
+	// OPERATIONS
+public:
+	// constructors
+	~multi_queue_snapshot() { release(); }
+	explicit multi_queue_snapshot(char const* path);
+	multi_queue_snapshot(multi_queue_snapshot && other) noexcept;
+	multi_queue_snapshot(multi_queue_snapshot const&) = delete;
+	multi_queue_snapshot& operator = (multi_queue_snapshot const&) = delete;
+
+	// capacity
+	size_type size() const noexcept { return static_cast<size_type>(file_header().elements); }
+	size_type level_count() const noexcept { return static_cast<size_type>(file_header().levels); }
+
+	// element access
+	ELEMENT_T const* level_data(size_type priority) const noexcept { return reinterpret_cast<ELEMENT_T const*>(bytes + table()[priority].offset); }
+	size_type level_size(size_type priority) const noexcept { return static_cast<size_type>(table()[priority].count); }
+
+	// format
+	static header make_header(size_type levels, size_type elements) noexcept;
+	static std::uint64_t align(std::uint64_t offset) noexcept { return (offset + alignment - 1) & ~std::uint64_t(alignment - 1); }
+	static std::uint64_t data_offset(size_type levels) noexcept { return align(sizeof(header) + levels * sizeof(level_entry)); }
+
+private:
+	header const& file_header() const noexcept { return *reinterpret_cast<header const*>(bytes); }
+	level_entry const* table() const noexcept { return reinterpret_cast<level_entry const*>(bytes + sizeof(header)); }
+	void validate() const;
+	void release() noexcept;
+};
+
+
+
+/*!	Multi-queue of FIFO priority levels; level 0 is served first.
+
+	LEVEL_T is the per-level FIFO container. It needs empty(), size(), front(), push() and pop(), so either
+	ring_buffer (the default) or std::queue can be used. The queue is allocator-aware: its allocator is the
+	level container's, and every level is constructed with it through uses-allocator construction.
+
+	STATS_T is the instrumentation policy. The default no_stats compiles away; level_stats records per-level
+	counters and, optionally, sojourn times, which stats() returns as a snapshot.
+
+	SCHEDULE_T is the dequeue policy choosing the level top() and pop() serve: strict_priority (the default),
+	weighted_round_robin or deficit_round_robin.
+
+	AGING_T is the promotion policy. With level_aging, elements that waited too long in a level are moved in
+	bulk to the level above; the default no_aging never promotes.
+
+	TRIM_T decides when dequeues shrink the queue. shrink_to_fit() drops the empty levels past the last
+	occupied one and releases the storage of drained levels; with watermark_trim it also runs on its own once
+	the load has fallen well below its peak, relocating the elements of levels that shrink. A trim policy is
+	told the queue size and the number of elements dequeued since it was last called, which pop_n() batches.
+
+	Level containers with handles (linked_queue) also let elements be tracked: push_tracked() returns a handle
+	through which erase() cancels the element and change_priority() moves it to the back of another level,
+	both in constant time. A handle stays valid until its element is popped or erased, through promotions,
+	shrink_to_fit(), moves and swaps of the queue, and merges that link levels.
+
+	merge() and splice() move whole levels of another queue behind the matching levels of this one, keeping
+	FIFO order. Levels that can link storage (chunked_queue, or a ring_buffer level that is empty here) are
+	taken over in constant time when the allocators compare equal; other levels move their elements.
+
+	Queues of trivially copyable elements can be saved to a binary snapshot and restored from a
+	multi_queue_snapshot of it, one bulk copy per level. Only the elements are saved; the policies restart
+	from their defaults and count the restored elements as pushes.
+*/
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>, class STATS_T = no_stats, class SCHEDULE_T = strict_priority, class AGING_T = no_aging, class TRIM_T = no_trim>
+class fixed_priority_multi_queue : private STATS_T, private SCHEDULE_T, private AGING_T, private TRIM_T {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using reference = value_type & ;
+	using const_reference = const value_type&;
+	using level_type = LEVEL_T;
+	using allocator_type = typename level_allocator<LEVEL_T>::type;
+	using stats_type = STATS_T;
+	using schedule_type = SCHEDULE_T;
+	using aging_type = AGING_T;
+	using trim_type = TRIM_T;
+	using handle = typename level_handle<LEVEL_T>::type;
+
+private:
+	using levels_allocator_type = typename scoped_allocator<
+		typename std::allocator_traits<allocator_type>::template rebind_alloc<LEVEL_T>>::type;
+	using levels_alloc_traits = std::allocator_traits<levels_allocator_type>;
+
+	// ATTRIBUTES
+private:
+	std::vector<LEVEL_T, levels_allocator_type>	queues;
+	occupancy_bitmap							occupied;
+	size_type									nElements = 0;
+
+	// OPERATIONS
+public:
+	// constructors
+	~fixed_priority_multi_queue() = default;
+	fixed_priority_multi_queue() = default;
+	explicit fixed_priority_multi_queue(allocator_type const& alloc) : queues(levels_allocator_type(alloc)) {}
+	explicit fixed_priority_multi_queue(SCHEDULE_T const& schedule, allocator_type const& alloc = allocator_type())
+		: SCHEDULE_T(schedule), queues(levels_allocator_type(alloc)) {}
+	explicit fixed_priority_multi_queue(AGING_T const& aging, allocator_type const& alloc = allocator_type())
+		: AGING_T(aging), queues(levels_allocator_type(alloc)) {}
+	fixed_priority_multi_queue(SCHEDULE_T const& schedule, AGING_T const& aging, allocator_type const& alloc = allocator_type())
+		: SCHEDULE_T(schedule), AGING_T(aging), queues(levels_allocator_type(alloc)) {}
+	fixed_priority_multi_queue(fixed_priority_multi_queue const& other) = default;
+	fixed_priority_multi_queue(fixed_priority_multi_queue const& other, allocator_type const& alloc)
+		: STATS_T(other), SCHEDULE_T(other), AGING_T(other), TRIM_T(other), queues(other.queues, levels_allocator_type(alloc)), occupied(other.occupied), nElements(other.nElements) {}
+	fixed_priority_multi_queue(fixed_priority_multi_queue && other) noexcept
+		: STATS_T(std::move(other)), SCHEDULE_T(std::move(other)), AGING_T(std::move(other)), TRIM_T(std::move(other)), queues(std::move(other.queues)), occupied(std::move(other.occupied)), nElements(other.nElements) {
+		other.queues.clear();
+		other.nElements = 0;
+		other.stats_policy().clear();
+		other.schedule_policy().clear();
+		other.aging_policy().clear();
+		other.trim_policy().clear();
+	}
+	fixed_priority_multi_queue(fixed_priority_multi_queue && other, allocator_type const& alloc)
+		: STATS_T(std::move(other)), SCHEDULE_T(std::move(other)), AGING_T(std::move(other)), TRIM_T(std::move(other)), queues(std::move(other.queues), levels_allocator_type(alloc)), occupied(std::move(other.occupied)), nElements(other.nElements) {
+		other.queues.clear();
+		other.nElements = 0;
+		other.stats_policy().clear();
+		other.schedule_policy().clear();
+		other.aging_policy().clear();
+		other.trim_policy().clear();
+	}
+	template <class FORWARD>
+	fixed_priority_multi_queue(FORWARD first, FORWARD last, allocator_type const& alloc = allocator_type());
+	explicit fixed_priority_multi_queue(multi_queue_snapshot<ELEMENT_T> const& snapshot, allocator_type const& alloc = allocator_type());
+
+	// member operators
+	fixed_priority_multi_queue& operator = (fixed_priority_multi_queue const& other);
+	fixed_priority_multi_queue& operator = (fixed_priority_multi_queue && other)
+		noexcept(levels_alloc_traits::propagate_on_container_move_assignment::value || levels_alloc_traits::is_always_equal::value);
+
+	allocator_type get_allocator() const noexcept { return allocator_type(queues.get_allocator()); }
+
+	// element access
+	reference top() noexcept;
+	const_reference top() const noexcept;
+	size_type top_priority() const noexcept { return next_level(); }
+
+	// capacity
+	bool empty() const noexcept { return nElements == 0; }
+	size_type size() const noexcept { return nElements; }
+	size_type max_priority() const noexcept { return queues.size(); }
+
+	// instrumentation
+	multi_queue_stats stats() const { return stats_policy().snapshot(); }
+
+	// scheduling
+	SCHEDULE_T& schedule() noexcept { return *this; }
+	SCHEDULE_T const& schedule() const noexcept { return *this; }
+	AGING_T const& aging() const noexcept { return *this; }
+	TRIM_T& trimming() noexcept { return *this; }
+	TRIM_T const& trimming() const noexcept { return *this; }
+
+	// modifiers
+	void push(value_type const& value, size_type priority);
+	void push(value_type && value, size_type priority);
+	template <class... ARGS>
+	reference emplace(size_type priority, ARGS&&... args);
+	template <class FORWARD>
+	void push_range(FORWARD first, FORWARD last, size_type priority);
+	template <class FORWARD>
+	void push_range(FORWARD first, FORWARD last);
+	void pop() noexcept;
+	std::optional<value_type> try_pop();
+	bool try_pop(value_type& value);
+	template <class OUTPUT>
+	OUTPUT pop_n(OUTPUT out, size_type n);
+	void swap(fixed_priority_multi_queue& other) noexcept;
+	void merge(fixed_priority_multi_queue && other);
+	void splice(fixed_priority_multi_queue& other, size_type priority);
+
+	// tracked elements
+	handle push_tracked(value_type const& value, size_type priority) { return emplace_tracked(priority, value); }
+	handle push_tracked(value_type && value, size_type priority) { return emplace_tracked(priority, std::move(value)); }
+	template <class... ARGS>
+	handle emplace_tracked(size_type priority, ARGS&&... args);
+	size_type priority_of(handle h) const noexcept { return LEVEL_T::tag(h); }
+	void erase(handle h) noexcept;
+	void change_priority(handle h, size_type priority);
+
+	// storage
+	void reserve(size_type n);
+	void shrink_to_fit();
+
+	// persistence
+	void save(std::ostream& out) const;
+
+private:
+	void grow(size_type levels);
+	void age() noexcept;
+	void auto_trim(size_type dequeued = 1) noexcept;
+	void splice_level(fixed_priority_multi_queue& other, size_type priority);
+	void settle_splice(fixed_priority_multi_queue& other, size_type priority, size_type moved) noexcept;
+	size_type next_level() const noexcept { return schedule_policy().select(occupied, queues); }
+	void prepare_push(size_type priority) {
+		stats_policy().prepare_push(priority);
+		aging_policy().prepare_push(priority);
+	}
+	void record_push(size_type priority, size_type depth) noexcept {
+		stats_policy().on_push(priority, depth);
+		aging_policy().on_push(priority);
+		trim_policy().on_push(nElements);
+	}
+	void record_pop(size_type priority) noexcept {
+		stats_policy().on_pop(priority);
+		aging_policy().on_pop(priority);
+	}
+	STATS_T& stats_policy() noexcept { return *this; }
+	STATS_T const& stats_policy() const noexcept { return *this; }
+	SCHEDULE_T& schedule_policy() noexcept { return *this; }
+	SCHEDULE_T const& schedule_policy() const noexcept { return *this; }
+	AGING_T& aging_policy() noexcept { return *this; }
+	TRIM_T& trim_policy() noexcept { return *this; }
+};
+
+
+
+// Helper functions
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+inline void swap(fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>& lhs, fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>& rhs) noexcept {
+	lhs.swap(rhs);
+}
+
+
+
+// Polymorphic-allocator aliases, the counterparts of std::pmr containers.
+template <class ELEMENT_T>
+using pmr_ring_buffer = ring_buffer<ELEMENT_T, std::pmr::polymorphic_allocator<ELEMENT_T>>;
+
+template <class ELEMENT_T>
+using pmr_fixed_priority_multi_queue = fixed_priority_multi_queue<ELEMENT_T, pmr_ring_buffer<ELEMENT_T>>;
+
+// Node-pool mode: every level draws its chunks from one free list owned by the queue.
+template <class ELEMENT_T, std::size_t CHUNK_SIZE = 32>
+using pooled_fixed_priority_multi_queue = fixed_priority_multi_queue<ELEMENT_T, pooled_chunked_queue<ELEMENT_T, CHUNK_SIZE>>;
+
+// Tracked mode: every element can be erased or re-prioritized through the handle push_tracked() returns.
+template <class ELEMENT_T>
+using tracked_fixed_priority_multi_queue = fixed_priority_multi_queue<ELEMENT_T, linked_queue<ELEMENT_T>>;
+
+
+
+/*!	Level layouts of concurrent_fixed_priority_multi_queue.
+
+	packed_levels stores the levels back to back, so the lock and the head, tail and count of one level share
+	cache lines with its neighbours, and producers on adjacent priorities invalidate each other's lines.
+	padded_levels gives every level a slot of its own, aligned to a cache line, at the cost of up to one line of
+	padding per level.
+*/
+struct packed_levels {
+	template <class LEVEL>
+	struct slot : LEVEL {};
+};
+
+struct padded_levels {
+	template <class LEVEL>
+	struct alignas(cache_line_size) slot : LEVEL {};
+};
+
+
+
+/*!	Wait strategies of concurrent_fixed_priority_multi_queue's blocking pops.
+
+	wait(ready, deadline) returns once ready() holds, or with ready()'s last result once the optional deadline
+	has passed; ready() is re-evaluated after every wake-up, spurious ones included. Producers call
+	notify_one() or notify_all() after every change that may make a waiter ready.
+	condition_wait parks consumers on a condition variable and is the right choice when consumers may idle
+	for long. busy_spin_wait and spin_yield_wait never sleep, trading a core per waiting consumer for the
+	lowest wake-up latency. futex_wait spins for an adaptive budget first and then sleeps on a futex, so a
+	producer pays for a system call only while a consumer is actually asleep.
+*/
+using wait_deadline = std::optional<std::chrono::steady_clock::time_point>;
+
+class condition_wait {
+
+	// ATTRIBUTES
+private:
+	std::atomic<std::size_t>	nWaiters{ 0 };
+	std::mutex					lock;
+	std::condition_variable		signal;
+
+	// OPERATIONS
+public:
+	template <class READY>
+	bool wait(READY ready, wait_deadline const& deadline);
+	void notify_one();
+	void notify_all();
+};
+
+
+// Polls ready() in a tight loop.
+struct busy_spin_wait {
+	template <class READY>
+	bool wait(READY ready, wait_deadline const& deadline);
+	void notify_one() noexcept {}
+	void notify_all() noexcept {}
+};
+
+
+// Polls ready() SPINS times, then yields the processor between polls.
+template <unsigned SPINS = 256>
+struct spin_yield_wait {
+	template <class READY>
+	bool wait(READY ready, wait_deadline const& deadline);
+	void notify_one() noexcept {}
+	void notify_all() noexcept {}
+};
+
+
+/*!	Spin-then-sleep wait strategy on a futex word (a mutex and condition variable off Linux).
+
+	The spin budget adapts between MIN_SPINS and MAX_SPINS: it doubles whenever spinning found an element and
+	halves whenever the waiter had to sleep, so it settles at the arrival gaps the consumers actually see.
+	Producers bump the futex word and wake a sleeper only while one is registered.
+*/
+template <unsigned MIN_SPINS = 16, unsigned MAX_SPINS = 4096>
+class futex_wait {
+
+	// ATTRIBUTES
+private:
+	alignas(cache_line_size) std::atomic<std::uint32_t>	epoch{ 0 };
+	std::atomic<std::size_t>							nSleepers{ 0 };
+	alignas(cache_line_size) std::atomic<unsigned>		spinBudget{ MIN_SPINS };
+#if !defined(__linux__)
+	std::mutex											lock;
+	std::condition_variable								signal;
+#endif
+
+	// OPERATIONS
+public:
+	unsigned spin_budget() const noexcept { return spinBudget.load(std::memory_order_relaxed); }
+
+	template <class READY>
+	bool wait(READY ready, wait_deadline const& deadline);
+	void notify_one() noexcept { wake(false); }
+	void notify_all() noexcept { wake(true); }
+
+private:
+	void sleep(std::uint32_t expected, wait_deadline const& deadline);
+	void wake(bool all) noexcept;
+};
+
+
+
+/*!	Thread-safe multi-queue with a fixed number of priority levels.
+
+	Every level has its own lock, so producers on different levels never contend, and consumers locate the
+	highest occupied level through an atomic occupancy bitmap instead of taking every lock in turn.
+	Blocking pops wait through WAIT_T (see condition_wait); producers only pay for a wake-up the strategy
+	asks for. The _within pops only take elements at priority p or better, so a latency-critical consumer
+	can wait for urgent work while a lower-priority backlog stays queued.
+	LAYOUT_T places the levels (see packed_levels). Either way the read-mostly members, the occupancy bitmap
+	among them, are kept off the cache lines of the element count and of the waiter bookkeeping, which
+	every push and pop writes.
+*/
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>, class LAYOUT_T = packed_levels, class WAIT_T = condition_wait>
+class concurrent_fixed_priority_multi_queue {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using level_type = LEVEL_T;
+	using layout_type = LAYOUT_T;
+	using wait_type = WAIT_T;
+
+private:
+	struct level_base {
+		std::mutex	lock;
+		LEVEL_T		items;
+	};
+	using level = typename LAYOUT_T::template slot<level_base>;
+
+	// ATTRIBUTES
+private:
+	size_type										nLevels;
+	std::unique_ptr<level[]>						levels;
+	atomic_occupancy_bitmap							occupied;
+	std::atomic<bool>								closed{ false };
+	alignas(cache_line_size) std::atomic<size_type>	nElements{ 0 };
+	alignas(cache_line_size) std::atomic<size_type>	nLimitedWaiters{ 0 };
+	WAIT_T											waiting;
+
+	// OPERATIONS
+public:
+	// constructors
+	explicit concurrent_fixed_priority_multi_queue(size_type max_priority);
+	concurrent_fixed_priority_multi_queue(concurrent_fixed_priority_multi_queue const&) = delete;
+	concurrent_fixed_priority_multi_queue& operator = (concurrent_fixed_priority_multi_queue const&) = delete;
+
+	// capacity
+	bool empty() const noexcept { return nElements.load() == 0; }
+	size_type size() const noexcept { return nElements.load(); }
+	size_type max_priority() const noexcept { return nLevels; }
+
+	// modifiers
+	bool push(value_type const& value, size_type priority);
+	bool push(value_type && value, size_type priority);
+	bool try_pop(value_type& value) { return try_pop_within(value, atomic_occupancy_bitmap::npos); }
+	bool wait_pop(value_type& value) { return wait_pop_until(value, atomic_occupancy_bitmap::npos, std::nullopt); }
+	template <class REP, class PERIOD>
+	bool wait_pop(value_type& value, std::chrono::duration<REP, PERIOD> const& timeout);
+	bool try_pop_within(value_type& value, size_type priority);
+	bool wait_pop_within(value_type& value, size_type priority) { return wait_pop_until(value, priority, std::nullopt); }
+	template <class REP, class PERIOD>
+	bool wait_pop_within(value_type& value, size_type priority, std::chrono::duration<REP, PERIOD> const& timeout);
+
+	// shutdown
+	void close();
+	bool is_closed() const noexcept { return closed.load(); }
+
+	// wait strategy
+	WAIT_T const& wait_strategy() const noexcept { return waiting; }
+
+private:
+	template <class VALUE>
+	bool push_value(VALUE&& value, size_type priority);
+	bool wait_pop_until(value_type& value, size_type priority, wait_deadline const& deadline);
+};
+
+// Concurrent multi-queue whose levels sit on cache lines of their own.
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>>
+using padded_concurrent_fixed_priority_multi_queue = concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, padded_levels>;
+
+
+
+/*!	Lock-free multi-queue with a fixed number of bounded priority levels.
+
+	Each level is a bounded_mpmc_ring sized at construction, and the highest occupied level is found through an
+	atomic occupancy bitmap. No operation ever blocks: try_push() reports a full level and try_pop() an empty
+	queue, leaving back-off to the caller.
+*/
+template <class ELEMENT_T>
+class lock_free_fixed_priority_multi_queue {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+
+	// ATTRIBUTES
+private:
+	std::vector<std::unique_ptr<bounded_mpmc_ring<ELEMENT_T>>>	levels;
+	atomic_occupancy_bitmap										occupied;
+	std::atomic<size_type>										nElements{ 0 };
+
+	// OPERATIONS
+public:
+	// constructors
+	lock_free_fixed_priority_multi_queue(size_type max_priority, size_type capacity);
+	lock_free_fixed_priority_multi_queue(lock_free_fixed_priority_multi_queue const&) = delete;
+	lock_free_fixed_priority_multi_queue& operator = (lock_free_fixed_priority_multi_queue const&) = delete;
+
+	// capacity
+	bool empty() const noexcept { return nElements.load() == 0; }
+	size_type size() const noexcept { return nElements.load(); }
+	size_type max_priority() const noexcept { return levels.size(); }
+	size_type capacity() const noexcept { return levels.empty() ? 0 : levels[0]->capacity(); }
+
+	// element access
+	size_type top_priority() const noexcept { return occupied.find_first(); }	// a hint, npos when empty
+
+	// modifiers
+	bool try_push(value_type const& value, size_type priority);
+	bool try_push(value_type && value, size_type priority);
+	bool try_pop(value_type& value);
+
+private:
+	template <class VALUE>
+	bool push_value(VALUE&& value, size_type priority);
+	void refresh(size_type priority) noexcept;
+};
+
+
+
+/*!	fixed_priority_multi_queue behind a mutex, advertising the priority of its top element.
+
+	The building block of the relaxed queue. Other threads choose between shards by loading top
+	without taking the lock; the hint sits on its own cache line, away from the owner's writes to the levels.
+	push() and pop() must be called with lock held.
+*/
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>>
+struct locked_shard {
+	using size_type = std::size_t;
+	static constexpr size_type npos = occupancy_bitmap::npos;
+
+	alignas(cache_line_size) std::atomic<size_type>	top{ npos };
+	alignas(cache_line_size) std::mutex				lock;
+	fixed_priority_multi_queue<ELEMENT_T, LEVEL_T>	items;
+	std::atomic<size_type>							nElements{ 0 };
+
+	template <class VALUE>
+	void push(VALUE&& value, size_type priority);
+	bool pop(ELEMENT_T& value);
+	void publish() noexcept;
+};
+
+
+
+/*!	Shard of a work-stealing queue: a lock-free window any thread may pop, backed by a fixed_priority_multi_queue
+	only the owner touches.
+
+	The owner pushes into the window's level while it has room and none of that level's elements wait in the
+	backlog, so every level stays FIFO across the two. Elements that do not fit wait in the backlog and move into
+	the window, best level first, as room frees up. push(), pop() and refill() are for the owner only; steal()
+	may be called by any thread and only ever sees the window.
+*/
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>>
+struct stealing_shard {
+	using size_type = std::size_t;
+	static constexpr size_type npos = occupancy_bitmap::npos;
+
+	lock_free_fixed_priority_multi_queue<ELEMENT_T>		window;
+	fixed_priority_multi_queue<ELEMENT_T, LEVEL_T>		backlog;
+	std::vector<size_type>								spilled;	// backlog elements per level
+	alignas(cache_line_size) std::atomic<size_type>		nElements{ 0 };
+
+	stealing_shard(size_type max_priority, size_type window_capacity);
+
+	size_type top_priority() const noexcept;
+	template <class VALUE>
+	void push(VALUE&& value, size_type priority);
+	bool pop(ELEMENT_T& value);
+	bool steal(ELEMENT_T& value);
+	void refill() noexcept;
+};
+
+
+
+/*!	Work-stealing multi-queue for many consumer threads, sharded into fixed_priority_multi_queues.
+
+	Each worker owns a shard, identified by an index below shard_count(), and is the only thread pushing to it
+	or popping through it. A shard keeps its elements in a lock-free window of bounded rings, one per level,
+	with a fixed_priority_multi_queue behind it for the elements that do not fit. Other workers steal the best
+	level of the window through the rings' CAS and never take a lock, so the window of a preempted owner stays
+	open to them. The backlog is private and moves into the window whenever its owner pushes or pops; a window
+	large enough for the usual load keeps everything stealable.
+
+	A pop serves the local top unless another shard's window holds a priority better by more than the
+	relaxation bound: 0 serves the best advertised element, larger bounds trade priority order for locality.
+	The windows are read without synchronization, so the bound holds against the state observed at the scan.
+	Like the other concurrent queues it has a fixed number of levels, and its elements must move without
+	throwing.
+*/
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>>
+class sharded_multi_queue {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using level_type = LEVEL_T;
+	static constexpr size_type npos = occupancy_bitmap::npos;
+
+private:
+	using shard = stealing_shard<ELEMENT_T, LEVEL_T>;
+
+	// ATTRIBUTES
+private:
+	size_type							nLevels;
+	size_type							relaxation;
+	std::vector<std::unique_ptr<shard>>	shards;
+
+	// OPERATIONS
+public:
+	// constructors
+	explicit sharded_multi_queue(size_type shard_count, size_type relaxation = 0, size_type max_priority = 64, size_type window_capacity = 64);
+	sharded_multi_queue(sharded_multi_queue const&) = delete;
+	sharded_multi_queue& operator = (sharded_multi_queue const&) = delete;
+
+	// capacity
+	bool empty() const noexcept;
+	size_type size() const noexcept;
+	size_type shard_count() const noexcept { return shards.size(); }
+	size_type max_priority() const noexcept { return nLevels; }
+	size_type relaxation_bound() const noexcept { return relaxation; }
+
+	// modifiers
+	void push(size_type shard, value_type const& value, size_type priority);
+	void push(size_type shard, value_type && value, size_type priority);
+	bool try_pop(size_type shard, value_type& value);
+
+private:
+	template <class VALUE>
+	void push_value(size_type shard, VALUE&& value, size_type priority);
+};
+
+
+
+/*!	Relaxed concurrent multi-queue after the MultiQueues algorithm: c*p fixed_priority_multi_queues behind try-locks.
+
+	push() stores into a randomly chosen instance, and try_pop() compares the advertised top priorities of two
+	random instances and pops from the better one. Neither ever waits for a lock; a busy instance is replaced by
+	another random choice. There is no global priority order: the rank error of a pop, the number of queued
+	elements with a better priority, is O(c*p) in expectation, and it buys throughput that keeps scaling with
+	threads because contention on any one instance stays low.
+*/
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>>
+class relaxed_multi_queue {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using level_type = LEVEL_T;
+
+private:
+	using shard = locked_shard<ELEMENT_T, LEVEL_T>;
+	static constexpr size_type npos = shard::npos;
+
+	// ATTRIBUTES
+private:
+	size_type					nQueues;
+	std::unique_ptr<shard[]>	queues;
+
+	// OPERATIONS
+public:
+	// constructors
+	explicit relaxed_multi_queue(size_type threads, size_type c = 2);
+	relaxed_multi_queue(relaxed_multi_queue const&) = delete;
+	relaxed_multi_queue& operator = (relaxed_multi_queue const&) = delete;
+
+	// capacity
+	bool empty() const noexcept;
+	size_type size() const noexcept;
+	size_type queue_count() const noexcept { return nQueues; }
+
+	// modifiers
+	void push(value_type const& value, size_type priority);
+	void push(value_type && value, size_type priority);
+	bool try_pop(value_type& value);
+
+private:
+	template <class VALUE>
+	void push_value(VALUE&& value, size_type priority);
+	size_type random_queue() const noexcept;
+};
+
+
+
+/*!	Multi-queue with a compile-time number of priority levels.
+
+	Levels live in a std::array and their occupancy in ceil(N/64) words (a single word for N <= 64) whose scan
+	is unrolled at compile time, so push never grows storage and top/pop reduce to a handful of instructions.
+	Priorities must be below N.
+*/
+template <class ELEMENT_T, std::size_t N, class LEVEL_T = ring_buffer<ELEMENT_T>>
+class static_multi_queue {
+	static_assert(N > 0, "static_multi_queue needs at least one priority level");
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using reference = value_type & ;
+	using const_reference = const value_type&;
+	using level_type = LEVEL_T;
+
+private:
+	using word_type = std::uint64_t;
+	static constexpr size_type bits_per_word = 64;
+	static constexpr size_type nWords = (N + bits_per_word - 1) / bits_per_word;
+
+	// ATTRIBUTES
+private:
+	std::array<LEVEL_T, N>					queues;
+	std::array<word_type, nWords>			occupied{};
+	size_type								nElements = 0;
+
+	// OPERATIONS
+public:
+	// constructors
+	static_multi_queue() = default;
+	template <class FORWARD>
+	static_multi_queue(FORWARD first, FORWARD last) {
+		for (; first != last; ++first) {
+			auto&& entry = *first;
+			emplace(entry.second, std::forward<decltype(entry)>(entry).first);
+		}
+	}
+
+	// element access
+	reference top() noexcept { return queues[first_occupied()].front(); }
+	const_reference top() const noexcept { return queues[first_occupied()].front(); }
+
+	// capacity
+	bool empty() const noexcept { return nElements == 0; }
+	size_type size() const noexcept { return nElements; }
+	static constexpr size_type max_priority() noexcept { return N; }
+
+	// modifiers
+	void push(value_type const& value, size_type priority);
+	void push(value_type && value, size_type priority);
+	template <class... ARGS>
+	reference emplace(size_type priority, ARGS&&... args);
+	void pop() noexcept;
+	void swap(static_multi_queue& other) noexcept;
+
+private:
+	size_type first_occupied() const noexcept { return first_occupied(std::make_index_sequence<nWords>()); }
+	template <size_type... WORD>
+	size_type first_occupied(std::index_sequence<WORD...>) const noexcept;
+	void mark_occupied(size_type priority) noexcept {
+		occupied[priority / bits_per_word] |= word_type(1) << (priority % bits_per_word);
+	}
+};
+
+
+
+// Helper functions
+template <class ELEMENT_T, std::size_t N, class LEVEL_T>
+inline void swap(static_multi_queue<ELEMENT_T, N, LEVEL_T>& lhs, static_multi_queue<ELEMENT_T, N, LEVEL_T>& rhs) noexcept {
+	lhs.swap(rhs);
+}
+
+
+
+/*!	Multi-queue for large, sparse priority keys; smaller keys are served first.
+
+	Only occupied levels are indexed: a deque of (priority, slot) entries sorted by priority, whose front is the
+	top level. top() and pop() are O(1), a push to an occupied level is a binary search, and opening a level
+	shifts the entries on the shorter side of it. Keys that arrive in increasing order, such as deadlines or
+	timestamps, open their levels at the back. The level containers live in slots that drained levels hand
+	back for reuse, with their storage, so memory follows the peak number of occupied levels rather than the
+	largest key.
+*/
+template <class ELEMENT_T, class LEVEL_T = ring_buffer<ELEMENT_T>>
+class sparse_priority_multi_queue {
+
+	// TYPES
+public:
+	using value_type = ELEMENT_T;
+	using size_type = std::size_t;
+	using reference = value_type & ;
+	using const_reference = const value_type&;
+	using level_type = LEVEL_T;
+
+private:
+	struct entry {
+		size_type	priority;
+		size_type	slot;
+	};
+
+	// ATTRIBUTES
+private:
+	std::deque<entry>		index;
+	std::vector<LEVEL_T>	levels;
+	std::vector<size_type>	spare;
+	size_type				nElements = 0;
+
+	// OPERATIONS
+public:
+	// constructors
+	~sparse_priority_multi_queue() = default;
+	sparse_priority_multi_queue() = default;
+	sparse_priority_multi_queue(sparse_priority_multi_queue const& other) = default;
+	sparse_priority_multi_queue(sparse_priority_multi_queue && other) noexcept
+		: index(std::move(other.index)), levels(std::move(other.levels)), spare(std::move(other.spare)), nElements(other.nElements) {
+		other.index.clear();
+		other.levels.clear();
+		other.spare.clear();
+		other.nElements = 0;
+	}
+	template <class FORWARD>
+	sparse_priority_multi_queue(FORWARD first, FORWARD last) {
+		for (; first != last; ++first) {
+			auto&& item = *first;
+			emplace(item.second, std::forward<decltype(item)>(item).first);
+		}
+	}
+
+	// member operators
+	sparse_priority_multi_queue& operator = (sparse_priority_multi_queue const& other) = default;
+	sparse_priority_multi_queue& operator = (sparse_priority_multi_queue && other) noexcept {
+		sparse_priority_multi_queue moved(std::move(other));
+		swap(moved);
+		return *this;
+	}
+
+	// element access
+	reference top() noexcept { return levels[index.front().slot].front(); }
+	const_reference top() const noexcept { return levels[index.front().slot].front(); }
+	size_type top_priority() const noexcept { return index.front().priority; }
+
+	// capacity
+	bool empty() const noexcept { return nElements == 0; }
+	size_type size() const noexcept { return nElements; }
+	size_type level_count() const noexcept { return index.size(); }
+
+	// modifiers
+	void push(value_type const& value, size_type priority) { emplace(priority, value); }
+	void push(value_type && value, size_type priority) { emplace(priority, std::move(value)); }
+	template <class... ARGS>
+	reference emplace(size_type priority, ARGS&&... args);
+	void pop() noexcept;
+	std::optional<value_type> try_pop();
+	bool try_pop(value_type& value);
+	void swap(sparse_priority_multi_queue& other) noexcept;
+
+	// storage
+	void shrink_to_fit();
+
+private:
+	size_type acquire_slot();
+};
+
+
+
+// Helper functions
+template <class ELEMENT_T, class LEVEL_T>
+inline void swap(sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>& lhs, sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>& rhs) noexcept {
+	lhs.swap(rhs);
+}
+
+// =============================================================================================================
+// IMPLEMENTATIONS
+// =============================================================================================================
+
+
+// occupancy_bitmap::find_first()
+inline occupancy_bitmap::size_type occupancy_bitmap::find_first() const noexcept {
+	if (none())
+		return npos;
+
+	size_type index = 0;
+	for (auto layer = layers.rbegin(); layer != layers.rend(); ++layer)
+		index = index * bits_per_word + count_trailing_zeros((*layer)[index]);
+
+	return index;
+}
+
+
+
+// occupancy_bitmap::find_next()
+// Climbs until a layer has a set bit at or after the position, then descends along the lowest set bits.
+inline occupancy_bitmap::size_type occupancy_bitmap::find_next(size_type from) const noexcept {
+	if (from >= nBits)
+		return npos;
+
+	size_type index = from;
+	size_type layer = 0;
+	for (;; ++layer) {
+		if (layer == layers.size() || index / bits_per_word >= layers[layer].size())
+			return npos;
+
+		word_type const word = layers[layer][index / bits_per_word] & (~word_type(0) << (index % bits_per_word));
+		if (word != 0) {
+			index = index / bits_per_word * bits_per_word + count_trailing_zeros(word);
+			break;
+		}
+		index = index / bits_per_word + 1;
+	}
+
+	for (; layer > 0; --layer)
+		index = index * bits_per_word + count_trailing_zeros(layers[layer - 1][index]);
+	return index;
+}
+
+
+
+// occupancy_bitmap::resize()
+inline void occupancy_bitmap::resize(size_type bits) {
+	if (bits <= nBits)
+		return;
+
+	// existing layers only gain zero words, so their summary bits stay valid
+	size_type words = (bits + bits_per_word - 1) / bits_per_word;
+	for (auto& layer : layers) {
+		layer.resize(words);
+		words = (words + bits_per_word - 1) / bits_per_word;
+	}
+
+	if (layers.empty())
+		layers.emplace_back(words);
+
+	// stack new summary layers until the top is a single word
+	while (layers.back().size() > 1) {
+		auto const& below = layers.back();
+		std::vector<word_type> above((below.size() + bits_per_word - 1) / bits_per_word);
+		for (size_type i = 0; i < below.size(); ++i)
+			if (below[i] != 0)
+				above[i / bits_per_word] |= word_type(1) << (i % bits_per_word);
+		layers.push_back(std::move(above));
+	}
+
+	nBits = bits;
+}
+
+
+
+// occupancy_bitmap::shrink()
+// Drops the bits from bits on, which must all be clear, and releases the words they used. The layers are
+// rebuilt at their new size, so a failed allocation leaves the bitmap unchanged.
+inline void occupancy_bitmap::shrink(size_type bits) {
+	if (bits >= nBits)
+		return;
+
+	occupancy_bitmap smaller;
+	smaller.resize(bits);
+	if (bits != 0)
+		for (size_type w = 0; w < smaller.layers[0].size(); ++w)
+			for (word_type word = layers[0][w]; word != 0; word &= word - 1)
+				smaller.set(w * bits_per_word + count_trailing_zeros(word));
+	swap(smaller);
+}
+
+
+
+// occupancy_bitmap::set()
+inline void occupancy_bitmap::set(size_type bit) noexcept {
+	for (auto& layer : layers) {
+		word_type& word = layer[bit / bits_per_word];
+		bool const wasEmpty = word == 0;
+		word |= word_type(1) << (bit % bits_per_word);
+		if (!wasEmpty)
+			return;
+		bit /= bits_per_word;
+	}
+}
+
+
+
+// occupancy_bitmap::reset()
+inline void occupancy_bitmap::reset(size_type bit) noexcept {
+	for (auto& layer : layers) {
+		word_type& word = layer[bit / bits_per_word];
+		word &= ~(word_type(1) << (bit % bits_per_word));
+		if (word != 0)
+			return;
+		bit /= bits_per_word;
+	}
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::~ring_buffer()
+template <class ELEMENT_T, class ALLOCATOR_T>
+ring_buffer<ELEMENT_T, ALLOCATOR_T>::~ring_buffer() {
+	clear();
+	release();
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::ring_buffer(copy, allocator)
+template <class ELEMENT_T, class ALLOCATOR_T>
+ring_buffer<ELEMENT_T, ALLOCATOR_T>::ring_buffer(ring_buffer const& other, allocator_type const& alloc) : alloc(alloc) {
+	if (other.empty())
+		return;
+
+	reserve(other.nElements);
+	for (size_type i = 0; i < other.nElements; ++i)
+		push(other.buffer[(other.head + i) & (other.nCapacity - 1)]);
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::ring_buffer(move, allocator)
+template <class ELEMENT_T, class ALLOCATOR_T>
+ring_buffer<ELEMENT_T, ALLOCATOR_T>::ring_buffer(ring_buffer && other, allocator_type const& alloc) : alloc(alloc) {
+	if (this->alloc == other.alloc) {
+		steal(other);
+		return;
+	}
+
+	// storage from another resource cannot be adopted, so move the elements across
+	reserve(other.nElements);
+	for (; !other.empty(); other.pop())
+		push(std::move(other.front()));
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::operator = (copy)
+template <class ELEMENT_T, class ALLOCATOR_T>
+ring_buffer<ELEMENT_T, ALLOCATOR_T>& ring_buffer<ELEMENT_T, ALLOCATOR_T>::operator = (ring_buffer const& other) {
+	if (this == &other)
+		return *this;
+
+	if constexpr (alloc_traits::propagate_on_container_copy_assignment::value) {
+		if (alloc != other.alloc) {
+			clear();
+			release();
+		}
+		alloc = other.alloc;
+	}
+
+	ring_buffer copy(other, alloc);
+	clear();
+	release();
+	steal(copy);
+	return *this;
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::operator = (move)
+template <class ELEMENT_T, class ALLOCATOR_T>
+ring_buffer<ELEMENT_T, ALLOCATOR_T>& ring_buffer<ELEMENT_T, ALLOCATOR_T>::operator = (ring_buffer && other)
+	noexcept(alloc_traits::propagate_on_container_move_assignment::value || alloc_traits::is_always_equal::value) {
+	if (this == &other)
+		return *this;
+
+	clear();
+	if (alloc_traits::propagate_on_container_move_assignment::value || alloc == other.alloc) {
+		release();
+		if constexpr (alloc_traits::propagate_on_container_move_assignment::value)
+			alloc = other.alloc;
+		steal(other);
+	}
+	else {
+		reserve(other.nElements);
+		for (; !other.empty(); other.pop())
+			push(std::move(other.front()));
+	}
+	return *this;
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::reserve()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::reserve(size_type capacity) {
+	if (capacity <= nCapacity)
+		return;
+
+	size_type rounded = nCapacity == 0 ? initial_capacity : nCapacity;
+	while (rounded < capacity)
+		rounded *= 2;
+
+	ELEMENT_T* target = alloc_traits::allocate(alloc, rounded);
+	try {
+		relocate(target);
+	}
+	catch (...) {
+		alloc_traits::deallocate(alloc, target, rounded);
+		throw;
+	}
+	if (buffer)
+		alloc_traits::deallocate(alloc, buffer, nCapacity);
+	buffer = target;
+	nCapacity = rounded;
+	head = 0;
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::shrink_to_fit()
+// Frees the block of an empty buffer; otherwise moves the elements to the smallest power of two that holds them.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::shrink_to_fit() {
+	if (nElements == 0) {
+		release();
+		return;
+	}
+
+	size_type rounded = initial_capacity;
+	while (rounded < nElements)
+		rounded *= 2;
+	if (rounded >= nCapacity)
+		return;
+
+	ELEMENT_T* target = alloc_traits::allocate(alloc, rounded);
+	try {
+		relocate(target);
+	}
+	catch (...) {
+		alloc_traits::deallocate(alloc, target, rounded);
+		throw;
+	}
+	alloc_traits::deallocate(alloc, buffer, nCapacity);
+	buffer = target;
+	nCapacity = rounded;
+	head = 0;
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::emplace()
+template <class ELEMENT_T, class ALLOCATOR_T>
+template <class... ARGS>
+typename ring_buffer<ELEMENT_T, ALLOCATOR_T>::reference ring_buffer<ELEMENT_T, ALLOCATOR_T>::emplace(ARGS&&... args) {
+	if (nElements < nCapacity) {
+		ELEMENT_T* slot = buffer + ((head + nElements) & (nCapacity - 1));
+		alloc_traits::construct(alloc, slot, std::forward<ARGS>(args)...);
+		++nElements;
+		return *slot;
+	}
+
+	// construct into the new block before relocating, in case ARGS refer to an element of this buffer
+	size_type const grown = nCapacity == 0 ? initial_capacity : nCapacity * 2;
+	ELEMENT_T* target = alloc_traits::allocate(alloc, grown);
+	try {
+		alloc_traits::construct(alloc, target + nElements, std::forward<ARGS>(args)...);
+	}
+	catch (...) {
+		alloc_traits::deallocate(alloc, target, grown);
+		throw;
+	}
+	try {
+		relocate(target);
+	}
+	catch (...) {
+		alloc_traits::destroy(alloc, target + nElements);
+		alloc_traits::deallocate(alloc, target, grown);
+		throw;
+	}
+
+	if (buffer)
+		alloc_traits::deallocate(alloc, buffer, nCapacity);
+	buffer = target;
+	nCapacity = grown;
+	head = 0;
+	return buffer[nElements++];
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::append()
+// Reallocates at most once. Pointer ranges of trivially copyable elements are copied with at most two
+// memcpy calls, one on each side of the wrap.
+template <class ELEMENT_T, class ALLOCATOR_T>
+template <class FORWARD>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::append(FORWARD first, FORWARD last) {
+	size_type const n = static_cast<size_type>(std::distance(first, last));
+	if (n == 0)
+		return;
+
+	reserve(nElements + n);
+	if constexpr (std::is_pointer<FORWARD>::value && std::is_trivially_copyable<ELEMENT_T>::value
+		&& std::is_same<std::remove_cv_t<std::remove_pointer_t<FORWARD>>, ELEMENT_T>::value) {
+		size_type const tail = (head + nElements) & (nCapacity - 1);
+		size_type const before_wrap = std::min(n, nCapacity - tail);
+		std::memcpy(buffer + tail, first, before_wrap * sizeof(ELEMENT_T));
+		std::memcpy(buffer, first + before_wrap, (n - before_wrap) * sizeof(ELEMENT_T));
+		nElements += n;
+	}
+	else {
+		for (; first != last; ++first)
+			emplace(*first);
+	}
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::splice()
+// Moves other's elements to the back. An empty buffer takes other's block in constant time when the
+// allocators allow it; otherwise the elements are moved after at most one reallocation. If a move throws, the
+// elements moved so far stay here and the rest stay in other.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::splice(ring_buffer& other) {
+	if (this == &other || other.nElements == 0)
+		return;
+
+	if (nElements == 0 && (alloc_traits::is_always_equal::value || alloc == other.alloc)) {
+		release();
+		steal(other);
+		return;
+	}
+
+	reserve(nElements + other.nElements);
+	for (; !other.empty(); other.pop())
+		emplace(std::move(other.front()));
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::for_each_span()
+// Calls f(data, count) for each run of contiguous elements: at most two, split where the buffer wraps.
+template <class ELEMENT_T, class ALLOCATOR_T>
+template <class FUNCTION>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::for_each_span(FUNCTION f) const {
+	if (nElements == 0)
+		return;
+
+	size_type const before_wrap = std::min(nElements, nCapacity - head);
+	f(static_cast<ELEMENT_T const*>(buffer + head), before_wrap);
+	if (before_wrap < nElements)
+		f(static_cast<ELEMENT_T const*>(buffer), nElements - before_wrap);
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::pop()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::pop() noexcept {
+	alloc_traits::destroy(alloc, buffer + head);
+	head = (head + 1) & (nCapacity - 1);
+	if (--nElements == 0)
+		head = 0;
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::clear()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::clear() noexcept {
+	while (!empty())
+		pop();
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::swap()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::swap(ring_buffer& other) noexcept {
+	if constexpr (alloc_traits::propagate_on_container_swap::value)
+		std::swap(alloc, other.alloc);
+	std::swap(buffer, other.buffer);
+	std::swap(nCapacity, other.nCapacity);
+	std::swap(head, other.head);
+	std::swap(nElements, other.nElements);
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::steal()
+// Takes over other's storage; the caller has already released ours and settled which allocator to keep.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::steal(ring_buffer& other) noexcept {
+	buffer = std::exchange(other.buffer, nullptr);
+	nCapacity = std::exchange(other.nCapacity, 0);
+	head = std::exchange(other.head, 0);
+	nElements = std::exchange(other.nElements, 0);
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::release()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::release() noexcept {
+	if (buffer)
+		alloc_traits::deallocate(alloc, buffer, nCapacity);
+	buffer = nullptr;
+	nCapacity = 0;
+	head = 0;
+}
+
+
+
+// ring_buffer<ELEMENT_T, ALLOCATOR_T>::relocate()
+// Moves the elements to the front of target in FIFO order. Only a throwing copy can fail, and it leaves this
+// buffer untouched.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void ring_buffer<ELEMENT_T, ALLOCATOR_T>::relocate(ELEMENT_T* target) {
+	if (nElements == 0)
+		return;
+
+	if constexpr (std::is_trivially_copyable<ELEMENT_T>::value) {
+		size_type const firstSpan = std::min(nElements, nCapacity - head);
+		std::memcpy(target, buffer + head, firstSpan * sizeof(ELEMENT_T));
+		std::memcpy(target + firstSpan, buffer, (nElements - firstSpan) * sizeof(ELEMENT_T));
+		return;
+	}
+
+	size_type i = 0;
+	try {
+		for (; i < nElements; ++i)
+			alloc_traits::construct(alloc, target + i, std::move_if_noexcept(buffer[(head + i) & (nCapacity - 1)]));
+	}
+	catch (...) {
+		while (i > 0)
+			alloc_traits::destroy(alloc, target + --i);
+		throw;
+	}
+
+	for (i = 0; i < nElements; ++i)
+		alloc_traits::destroy(alloc, buffer + ((head + i) & (nCapacity - 1)));
+}
+
+
+
+// chunk_pool<CHUNK_T>::~chunk_pool()
+template <class CHUNK_T>
+chunk_pool<CHUNK_T>::~chunk_pool() {
+	trim();
+}
+
+
+
+// chunk_pool<CHUNK_T>::trim()
+// Frees the chunks on the free list; chunks still held by queues are untouched.
+template <class CHUNK_T>
+void chunk_pool<CHUNK_T>::trim() noexcept {
+	while (freeList) {
+		free_block* block = freeList;
+		freeList = block->next;
+		::operator delete(block, std::align_val_t(alignof(CHUNK_T)));
+	}
+	nAllocated -= nFree;
+	nFree = 0;
+}
+
+
+
+// chunk_pool<CHUNK_T>::reserve()
+template <class CHUNK_T>
+void chunk_pool<CHUNK_T>::reserve(size_type chunks) {
+	while (nFree < chunks) {
+		release(allocate_block());
+		++nAllocated;
+	}
+}
+
+
+
+// chunk_pool<CHUNK_T>::acquire()
+template <class CHUNK_T>
+void* chunk_pool<CHUNK_T>::acquire() {
+	if (!freeList) {
+		void* block = allocate_block();
+		++nAllocated;
+		return block;
+	}
+
+	free_block* block = freeList;
+	freeList = block->next;
+	--nFree;
+	return block;
+}
+
+
+
+// chunk_pool<CHUNK_T>::release()
+template <class CHUNK_T>
+void chunk_pool<CHUNK_T>::release(void* block) noexcept {
+	freeList = ::new (block) free_block{ freeList };
+	++nFree;
+}
+
+
+
+// pool_allocator<ELEMENT_T, CHUNK_T>::allocate()
+template <class ELEMENT_T, class CHUNK_T>
+ELEMENT_T* pool_allocator<ELEMENT_T, CHUNK_T>::allocate(size_type n) {
+	if constexpr (std::is_same<ELEMENT_T, CHUNK_T>::value)
+		if (n == 1)
+			return static_cast<ELEMENT_T*>(pool->acquire());
+
+	return static_cast<ELEMENT_T*>(::operator new(n * sizeof(ELEMENT_T), std::align_val_t(alignof(ELEMENT_T))));
+}
+
+
+
+// pool_allocator<ELEMENT_T, CHUNK_T>::deallocate()
+template <class ELEMENT_T, class CHUNK_T>
+void pool_allocator<ELEMENT_T, CHUNK_T>::deallocate(ELEMENT_T* p, size_type n) noexcept {
+	if constexpr (std::is_same<ELEMENT_T, CHUNK_T>::value)
+		if (n == 1) {
+			pool->release(p);
+			return;
+		}
+
+	::operator delete(p, std::align_val_t(alignof(ELEMENT_T)));
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::~chunked_queue()
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::~chunked_queue() {
+	clear();
+	release();
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::chunked_queue(copy, allocator)
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::chunked_queue(chunked_queue const& other, allocator_type const& alloc) : alloc(alloc) {
+	try {
+		for (chunk_type const* chunk = other.head; chunk; chunk = chunk->next)
+			for (size_type i = chunk->first; i < chunk->last; ++i)
+				push(*chunk->slot(i));
+	}
+	catch (...) {
+		clear();
+		release();
+		throw;
+	}
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::chunked_queue(move, allocator)
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::chunked_queue(chunked_queue && other, allocator_type const& alloc) : alloc(alloc) {
+	if (this->alloc == other.alloc)
+		steal(other);
+	else
+		append_from(other);
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::operator = (copy)
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>& chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::operator = (chunked_queue const& other) {
+	if (this == &other)
+		return *this;
+
+	clear();
+	if constexpr (chunk_traits::propagate_on_container_copy_assignment::value) {
+		if (alloc != other.alloc)
+			release();
+		alloc = other.alloc;
+	}
+
+	for (chunk_type const* chunk = other.head; chunk; chunk = chunk->next)
+		for (size_type i = chunk->first; i < chunk->last; ++i)
+			push(*chunk->slot(i));
+	return *this;
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::operator = (move)
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>& chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::operator = (chunked_queue && other)
+	noexcept(chunk_traits::propagate_on_container_move_assignment::value || chunk_traits::is_always_equal::value) {
+	if (this == &other)
+		return *this;
+
+	clear();
+	if (chunk_traits::propagate_on_container_move_assignment::value || alloc == other.alloc) {
+		release();
+		if constexpr (chunk_traits::propagate_on_container_move_assignment::value)
+			alloc = other.alloc;
+		steal(other);
+	}
+	else
+		append_from(other);
+	return *this;
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::emplace()
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+template <class... ARGS>
+typename chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::reference chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::emplace(ARGS&&... args) {
+	if (!tail) {
+		head = tail = new_chunk();
+	}
+	else if (tail->last == CHUNK_SIZE) {
+		// construct first so that a throwing constructor leaves no empty chunk behind
+		chunk_type* chunk = new_chunk();
+		try {
+			::new (static_cast<void*>(chunk->slot(0))) ELEMENT_T(std::forward<ARGS>(args)...);
+		}
+		catch (...) {
+			delete_chunk(chunk);
+			throw;
+		}
+		chunk->last = 1;
+		tail->next = chunk;
+		tail = chunk;
+		++nElements;
+		return *chunk->slot(0);
+	}
+
+	ELEMENT_T* slot = tail->slot(tail->last);
+	::new (static_cast<void*>(slot)) ELEMENT_T(std::forward<ARGS>(args)...);
+	++tail->last;
+	++nElements;
+	return *slot;
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::pop()
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::pop() noexcept {
+	head->slot(head->first)->~ELEMENT_T();
+	++head->first;
+	--nElements;
+	if (head->first < head->last)
+		return;
+
+	if (head == tail) {
+		head->first = head->last = 0;	// keep the last chunk for the next push
+		return;
+	}
+
+	chunk_type* drained = head;
+	head = head->next;
+	delete_chunk(drained);
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::clear()
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::clear() noexcept {
+	while (!empty())
+		pop();
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::splice()
+// Links other's chunks behind the tail in constant time when both queues draw on the same allocator; the old
+// tail may then stay partly filled in the middle of the chain. With different allocators the elements are moved.
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::splice(chunked_queue& other) {
+	if (this == &other || other.nElements == 0)
+		return;
+
+	if (alloc != other.alloc) {
+		append_from(other);
+		return;
+	}
+
+	if (nElements == 0) {
+		release();
+		steal(other);
+		return;
+	}
+
+	tail->next = std::exchange(other.head, nullptr);
+	tail = std::exchange(other.tail, nullptr);
+	nElements += std::exchange(other.nElements, 0);
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::for_each_span()
+// Calls f(data, count) once per chunk holding elements, front to back.
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+template <class FUNCTION>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::for_each_span(FUNCTION f) const {
+	for (chunk_type const* chunk = head; chunk; chunk = chunk->next)
+		if (chunk->last != chunk->first)
+			f(chunk->slot(chunk->first), chunk->last - chunk->first);
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::swap()
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::swap(chunked_queue& other) noexcept {
+	if constexpr (chunk_traits::propagate_on_container_swap::value)
+		std::swap(alloc, other.alloc);
+	std::swap(head, other.head);
+	std::swap(tail, other.tail);
+	std::swap(nElements, other.nElements);
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::new_chunk()
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+typename chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::chunk_type* chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::new_chunk() {
+	return ::new (static_cast<void*>(chunk_traits::allocate(alloc, 1))) chunk_type;
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::delete_chunk()
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::delete_chunk(chunk_type* chunk) noexcept {
+	chunk->~chunk_type();
+	chunk_traits::deallocate(alloc, chunk, 1);
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::steal()
+// Takes over other's chunks; the caller has already released ours and settled which allocator to keep.
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::steal(chunked_queue& other) noexcept {
+	head = std::exchange(other.head, nullptr);
+	tail = std::exchange(other.tail, nullptr);
+	nElements = std::exchange(other.nElements, 0);
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::release()
+// Returns the chunks of an already cleared queue.
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::release() noexcept {
+	while (head) {
+		chunk_type* chunk = head;
+		head = head->next;
+		delete_chunk(chunk);
+	}
+	tail = nullptr;
+}
+
+
+
+// chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::append_from()
+// Moves other's elements to the back one by one, for when its chunks belong to a different allocator.
+template <class ELEMENT_T, class ALLOCATOR_T, std::size_t CHUNK_SIZE>
+void chunked_queue<ELEMENT_T, ALLOCATOR_T, CHUNK_SIZE>::append_from(chunked_queue& other) {
+	for (; !other.empty(); other.pop())
+		push(std::move(other.front()));
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::linked_queue(copy, allocator)
+template <class ELEMENT_T, class ALLOCATOR_T>
+linked_queue<ELEMENT_T, ALLOCATOR_T>::linked_queue(linked_queue const& other, allocator_type const& alloc) : alloc(alloc) {
+	try {
+		copy_from(other);
+	}
+	catch (...) {
+		clear();
+		throw;
+	}
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::linked_queue(move, allocator)
+template <class ELEMENT_T, class ALLOCATOR_T>
+linked_queue<ELEMENT_T, ALLOCATOR_T>::linked_queue(linked_queue && other, allocator_type const& alloc) : alloc(alloc) {
+	if (this->alloc == other.alloc)
+		steal(other);
+	else
+		append_from(other);
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::operator = (copy)
+template <class ELEMENT_T, class ALLOCATOR_T>
+linked_queue<ELEMENT_T, ALLOCATOR_T>& linked_queue<ELEMENT_T, ALLOCATOR_T>::operator = (linked_queue const& other) {
+	if (this == &other)
+		return *this;
+
+	clear();
+	if constexpr (node_traits::propagate_on_container_copy_assignment::value)
+		alloc = other.alloc;
+	copy_from(other);
+	return *this;
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::operator = (move)
+template <class ELEMENT_T, class ALLOCATOR_T>
+linked_queue<ELEMENT_T, ALLOCATOR_T>& linked_queue<ELEMENT_T, ALLOCATOR_T>::operator = (linked_queue && other)
+	noexcept(node_traits::propagate_on_container_move_assignment::value || node_traits::is_always_equal::value) {
+	if (this == &other)
+		return *this;
+
+	clear();
+	if (node_traits::propagate_on_container_move_assignment::value || alloc == other.alloc) {
+		if constexpr (node_traits::propagate_on_container_move_assignment::value)
+			alloc = other.alloc;
+		steal(other);
+	}
+	else
+		append_from(other);
+	return *this;
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::for_each_span()
+// Every node is a run of one element.
+template <class ELEMENT_T, class ALLOCATOR_T>
+template <class FUNCTION>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::for_each_span(FUNCTION f) const {
+	for (node_type const* node = head; node; node = node->next)
+		f(node->value(), size_type(1));
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::emplace_tracked()
+template <class ELEMENT_T, class ALLOCATOR_T>
+template <class... ARGS>
+typename linked_queue<ELEMENT_T, ALLOCATOR_T>::handle linked_queue<ELEMENT_T, ALLOCATOR_T>::emplace_tracked(ARGS&&... args) {
+	node_type* node = node_traits::allocate(alloc, 1);
+	::new (static_cast<void*>(node)) node_type;
+	try {
+		::new (static_cast<void*>(node->value())) ELEMENT_T(std::forward<ARGS>(args)...);
+	}
+	catch (...) {
+		node->~node_type();
+		node_traits::deallocate(alloc, node, 1);
+		throw;
+	}
+	link_back(node);
+	return handle(node);
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::erase()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::erase(handle h) noexcept {
+	node_type* node = h.node;
+	unlink(node);
+	node->value()->~ELEMENT_T();
+	node->~node_type();
+	node_traits::deallocate(alloc, node, 1);
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::relink()
+// Moves the element to the back of target without touching it. Both queues must share the allocator, which
+// frees the node.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::relink(handle h, linked_queue& target) noexcept {
+	assert(alloc == target.alloc);
+	unlink(h.node);
+	target.link_back(h.node);
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::splice()
+// Links other's nodes behind the tail in constant time when both queues draw on the same allocator; with
+// different allocators the elements are moved.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::splice(linked_queue& other) {
+	if (this == &other || other.nElements == 0)
+		return;
+
+	if (alloc != other.alloc) {
+		append_from(other);
+		return;
+	}
+
+	if (tail) {
+		tail->next = other.head;
+		other.head->prev = tail;
+	}
+	else
+		head = other.head;
+	tail = std::exchange(other.tail, nullptr);
+	other.head = nullptr;
+	nElements += std::exchange(other.nElements, 0);
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::clear()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::clear() noexcept {
+	while (!empty())
+		pop();
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::swap()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::swap(linked_queue& other) noexcept {
+	if constexpr (node_traits::propagate_on_container_swap::value)
+		std::swap(alloc, other.alloc);
+	std::swap(head, other.head);
+	std::swap(tail, other.tail);
+	std::swap(nElements, other.nElements);
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::link_back()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::link_back(node_type* node) noexcept {
+	node->prev = tail;
+	node->next = nullptr;
+	if (tail)
+		tail->next = node;
+	else
+		head = node;
+	tail = node;
+	++nElements;
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::unlink()
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::unlink(node_type* node) noexcept {
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		head = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+	else
+		tail = node->prev;
+	--nElements;
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::steal()
+// Takes over other's nodes; the caller has already cleared this queue and settled which allocator to keep.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::steal(linked_queue& other) noexcept {
+	head = std::exchange(other.head, nullptr);
+	tail = std::exchange(other.tail, nullptr);
+	nElements = std::exchange(other.nElements, 0);
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::copy_from()
+// Appends copies of other's elements, tags included.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::copy_from(linked_queue const& other) {
+	for (node_type const* node = other.head; node; node = node->next)
+		tag(emplace_tracked(*node->value())) = node->tag;
+}
+
+
+
+// linked_queue<ELEMENT_T, ALLOCATOR_T>::append_from()
+// Moves other's elements to the back one by one, tags included, for when its nodes belong to a different
+// allocator.
+template <class ELEMENT_T, class ALLOCATOR_T>
+void linked_queue<ELEMENT_T, ALLOCATOR_T>::append_from(linked_queue& other) {
+	for (; !other.empty(); other.pop())
+		tag(emplace_tracked(std::move(other.front()))) = other.head->tag;
+}
+
+
+
+// level_stats::on_grow()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_grow(size_type count) {
+	if (count <= levels.size())
+		return;	// counters kept from before a shrink already cover the levels
+
+	levels.resize(count);
+	if constexpr (TIMESTAMPS) {
+		sojourn.resize(count);
+		enqueued.resize(count);
+	}
+}
+
+
+
+// level_stats::on_shrink()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_shrink(size_type) {
+	if constexpr (TIMESTAMPS)
+		for (auto& e : enqueued)
+			e.shrink_to_fit();
+}
+
+
+
+// level_stats::prepare_push()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::prepare_push(size_type priority) {
+	if constexpr (TIMESTAMPS) {
+		auto& times = enqueued[priority];
+		if (times.size() == times.capacity())
+			times.reserve(times.size() + 1);
+	}
+}
+
+
+
+// level_stats::on_push()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_push(size_type priority, size_type depth) noexcept {
+	auto& level = levels[priority];
+	++level.pushes;
+	level.max_depth = std::max(level.max_depth, depth);
+	if constexpr (TIMESTAMPS)
+		enqueued[priority].push(CLOCK::now());
+}
+
+
+
+// level_stats::on_pop()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_pop(size_type priority) noexcept {
+	++levels[priority].pops;
+	if constexpr (TIMESTAMPS) {
+		auto& times = enqueued[priority];
+		auto const waited = std::chrono::duration_cast<std::chrono::nanoseconds>(CLOCK::now() - times.front()).count();
+		times.pop();
+
+		size_type bucket = 0;
+		if (waited > 0)
+			bucket = std::min<size_type>(highest_set_bit(static_cast<std::uint64_t>(waited)), multi_queue_stats::sojourn_buckets - 1);
+		++sojourn[priority][bucket];
+	}
+}
+
+
+
+// level_stats::prepare_transfer()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::prepare_transfer(size_type to, size_type count) {
+	if constexpr (TIMESTAMPS)
+		enqueued[to].reserve(enqueued[to].size() + count);
+}
+
+
+
+// level_stats::on_transfer()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_transfer(size_type from, size_type to, size_type count, size_type depth) noexcept {
+	levels[from].promoted += count;
+	levels[to].max_depth = std::max(levels[to].max_depth, depth);
+	if constexpr (TIMESTAMPS) {
+		for (auto& times = enqueued[from]; count != 0; --count) {
+			enqueued[to].push(times.front());
+			times.pop();
+		}
+	}
+}
+
+
+
+// level_stats::prepare_splice()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::prepare_splice(size_type priority, size_type count) {
+	if constexpr (TIMESTAMPS)
+		enqueued[priority].reserve(enqueued[priority].size() + count);
+}
+
+
+
+// level_stats::on_splice()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_splice(level_stats& source, size_type priority, size_type count, size_type depth) noexcept {
+	auto& level = levels[priority];
+	level.pushes += count;
+	level.max_depth = std::max(level.max_depth, depth);
+	if constexpr (TIMESTAMPS) {
+		for (auto& times = source.enqueued[priority]; count != 0; --count) {
+			enqueued[priority].push(times.front());
+			times.pop();
+		}
+	}
+}
+
+
+
+// level_stats::on_erase()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_erase(size_type priority) noexcept {
+	++levels[priority].erased;
+	if constexpr (TIMESTAMPS)
+		enqueued[priority].pop();
+}
+
+
+
+// level_stats::on_move()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::on_move(size_type priority) noexcept {
+	++levels[priority].moved;
+	if constexpr (TIMESTAMPS)
+		enqueued[priority].pop();
+}
+
+
+
+// level_stats::clear()
+template <bool TIMESTAMPS, class CLOCK>
+void level_stats<TIMESTAMPS, CLOCK>::clear() noexcept {
+	levels.clear();
+	sojourn.clear();
+	enqueued.clear();
+}
+
+
+
+// level_stats::snapshot()
+template <bool TIMESTAMPS, class CLOCK>
+multi_queue_stats level_stats<TIMESTAMPS, CLOCK>::snapshot() const {
+	multi_queue_stats stats;
+	stats.levels = levels;
+	stats.sojourn = sojourn;
+	return stats;
+}
+
+
+
+// deficit_round_robin::deficit_round_robin()
+template <class COST_T>
+deficit_round_robin<COST_T>::deficit_round_robin(std::vector<size_type> quanta, size_type default_quantum, COST_T cost)
+	: quanta(std::move(quanta)), defaultQuantum(default_quantum), cost(std::move(cost)) {
+	if (defaultQuantum == 0 || std::find(this->quanta.begin(), this->quanta.end(), size_type(0)) != this->quanta.end())
+		throw std::invalid_argument("deficit_round_robin quanta must be positive");
+}
+
+
+
+// deficit_round_robin::set_quantum()
+template <class COST_T>
+void deficit_round_robin<COST_T>::set_quantum(size_type priority, size_type quantum) {
+	if (quantum == 0)
+		throw std::invalid_argument("deficit_round_robin quanta must be positive");
+	if (priority >= quanta.size())
+		quanta.resize(priority + 1, defaultQuantum);
+	quanta[priority] = quantum;
+}
+
+
+
+// deficit_round_robin::on_grow()
+template <class COST_T>
+void deficit_round_robin<COST_T>::on_grow(size_type levels) {
+	deficits.resize(levels);
+}
+
+
+
+// deficit_round_robin::on_shrink()
+// The dropped levels are empty and have forfeited their deficits; a round standing on one starts over.
+template <class COST_T>
+void deficit_round_robin<COST_T>::on_shrink(size_type levels) {
+	deficits.resize(levels);
+	deficits.shrink_to_fit();
+	if (current != npos && current >= levels)
+		current = npos;
+}
+
+
+
+// deficit_round_robin::select()
+// Stays on the current level while its front fits the deficit, otherwise moves on to the next non-empty level,
+// wrapping to the first, and credits it one quantum per visit. Must not be called on an empty queue.
+template <class COST_T>
+template <class LEVELS>
+typename deficit_round_robin<COST_T>::size_type deficit_round_robin<COST_T>::select(occupancy_bitmap const& occupied, LEVELS const& levels) const noexcept {
+	if (current != npos && occupied.test(current) && cost(levels[current].front()) <= deficits[current])
+		return current;
+
+	for (;;) {
+		size_type next = current == npos ? npos : occupied.find_next(current + 1);
+		if (next == npos)
+			next = occupied.find_first();
+
+		current = next;
+		deficits[current] += quantum(current);
+		if (cost(levels[current].front()) <= deficits[current])
+			return current;
+	}
+}
+
+
+
+// deficit_round_robin::on_serve()
+template <class COST_T>
+template <class ELEMENT_T>
+void deficit_round_robin<COST_T>::on_serve(size_type priority, ELEMENT_T const& element) noexcept {
+	deficits[priority] -= std::min(deficits[priority], static_cast<size_type>(cost(element)));
+}
+
+
+
+// deficit_round_robin::clear()
+template <class COST_T>
+void deficit_round_robin<COST_T>::clear() noexcept {
+	deficits.clear();
+	current = npos;
+}
+
+
+
+// level_aging::level_aging()
+template <class CLOCK>
+level_aging<CLOCK>::level_aging(duration threshold, size_type promotion_limit)
+	: threshold(threshold), granularity(std::max(threshold / 8, duration(1))), limit(promotion_limit) {
+	if (limit == 0)
+		throw std::invalid_argument("level_aging promotion limit must be positive");
+}
+
+
+
+// level_aging::on_grow()
+template <class CLOCK>
+void level_aging<CLOCK>::on_grow(size_type levels) {
+	runs.resize(levels);
+}
+
+
+
+// level_aging::on_shrink()
+template <class CLOCK>
+void level_aging<CLOCK>::on_shrink(size_type levels) {
+	runs.resize(levels);
+	runs.shrink_to_fit();
+	for (auto& r : runs)
+		r.shrink_to_fit();
+	if (cursor >= levels)
+		cursor = 0;
+}
+
+
+
+// level_aging::prepare_push()
+template <class CLOCK>
+void level_aging<CLOCK>::prepare_push(size_type priority) {
+	prepare_transfer(priority);
+}
+
+
+
+// level_aging::on_push()
+// Level 0 has nowhere to be promoted to, so its pushes are not tracked.
+template <class CLOCK>
+void level_aging<CLOCK>::on_push(size_type priority) noexcept {
+	if (priority == 0)
+		return;
+
+	auto& level = runs[priority];
+	time_point const t = now();
+	if (!level.empty() && t - level.back().since < granularity)
+		++level.back().count;
+	else
+		level.push(run{ t, 1 });
+}
+
+
+
+// level_aging::on_pop()
+template <class CLOCK>
+void level_aging<CLOCK>::on_pop(size_type priority) noexcept {
+	++dequeues;
+	if (priority == 0)
+		return;
+
+	auto& level = runs[priority];
+	if (--level.front().count == 0)
+		level.pop();
+}
+
+
+
+// level_aging::expired()
+// Returns the next occupied level after the last one checked and how many elements of its oldest run to
+// promote if that run has reached the threshold, or a count of 0. A run longer than the limit keeps the cursor
+// before its level, so the next check comes back for the rest.
+template <class CLOCK>
+std::pair<typename level_aging<CLOCK>::size_type, typename level_aging<CLOCK>::size_type> level_aging<CLOCK>::expired(occupancy_bitmap const& occupied) noexcept {
+	size_type level = occupied.find_next(cursor + 1);
+	if (level == npos)
+		level = occupied.find_next(1);
+	if (level == npos)
+		return { 0, 0 };
+
+	cursor = level;
+	run const& oldest = runs[level].front();
+	if (now() - oldest.since < threshold)
+		return { level, 0 };
+	if (oldest.count > limit) {
+		cursor = level - 1;
+		return { level, limit };
+	}
+	return { level, oldest.count };
+}
+
+
+
+// level_aging::prepare_transfer()
+template <class CLOCK>
+void level_aging<CLOCK>::prepare_transfer(size_type to) {
+	auto& level = runs[to];
+	if (to != 0 && level.size() == level.capacity())
+		level.reserve(level.size() + 1);
+}
+
+
+
+// level_aging::on_transfer()
+// The promoted elements leave the front runs of their level and join the level above as its newest run.
+template <class CLOCK>
+void level_aging<CLOCK>::on_transfer(size_type from, size_type to, size_type count) noexcept {
+	auto& source = runs[from];
+	for (size_type left = count; left != 0;) {
+		run& oldest = source.front();
+		size_type const taken = std::min(left, oldest.count);
+		oldest.count -= taken;
+		left -= taken;
+		if (oldest.count == 0)
+			source.pop();
+	}
+
+	if (to == 0)
+		return;
+
+	auto& target = runs[to];
+	time_point const t = now();
+	if (!target.empty() && t - target.back().since < granularity)
+		target.back().count += count;
+	else
+		target.push(run{ t, count });
+}
+
+
+
+// level_aging::prepare_splice()
+template <class CLOCK>
+void level_aging<CLOCK>::prepare_splice(size_type priority, level_aging const& source) {
+	if (priority != 0)
+		runs[priority].reserve(runs[priority].size() + source.runs[priority].size());
+}
+
+
+
+// level_aging::on_splice()
+// The spliced elements leave the front runs of source's level for the back of this one and keep the age
+// source measured for them. A run that would be older than this level's newest is clamped to it, so the runs
+// stay in order; those elements sit behind the newest run anyway.
+template <class CLOCK>
+void level_aging<CLOCK>::on_splice(level_aging& source, size_type priority, size_type count) noexcept {
+	if (priority == 0)
+		return;
+
+	auto& from = source.runs[priority];
+	auto& to = runs[priority];
+	time_point const t = now();
+	time_point const origin = source.now();
+	while (count != 0) {
+		run& oldest = from.front();
+		size_type const taken = std::min(count, oldest.count);
+		duration const age = origin - oldest.since;
+		time_point since = age < t - time_point() ? t - age : time_point();
+		if (!to.empty())
+			since = std::max(since, to.back().since);
+
+		if (!to.empty() && since - to.back().since < granularity)
+			to.back().count += taken;
+		else
+			to.push(run{ since, taken });
+
+		oldest.count -= taken;
+		count -= taken;
+		if (oldest.count == 0)
+			from.pop();
+	}
+}
+
+
+
+// level_aging::on_erase()
+template <class CLOCK>
+void level_aging<CLOCK>::on_erase(size_type priority) noexcept {
+	if (priority == 0)
+		return;
+
+	auto& level = runs[priority];
+	if (--level.front().count == 0)
+		level.pop();
+}
+
+
+
+// level_aging::clear()
+template <class CLOCK>
+void level_aging<CLOCK>::clear() noexcept {
+	runs.clear();
+	dequeues = 0;
+	cursor = 0;
+}
+
+
+
+// level_aging::now()
+template <class CLOCK>
+typename level_aging<CLOCK>::time_point level_aging<CLOCK>::now() const noexcept {
+	if constexpr (std::is_same<CLOCK, dequeue_clock>::value)
+		return dequeues;
+	else
+		return CLOCK::now();
+}
+
+
+
+// watermark_trim::watermark_trim()
+inline watermark_trim::watermark_trim(size_type window, size_type ratio) : window(window), ratio(ratio) {
+	if (window == 0 || ratio < 2)
+		throw std::invalid_argument("watermark_trim needs a non-empty window and a ratio of at least 2");
+}
+
+
+
+// watermark_trim::on_pop()
+// Returns true when the queue should shrink after count dequeues that left size elements. A window's peak
+// starts from the size the window opened with; a batch can close several windows, each opening with the
+// elements the rest of the batch still had to take.
+inline bool watermark_trim::on_pop(size_type size, size_type count) noexcept {
+	bool trim = false;
+	for (dequeues += count; dequeues >= window; dequeues -= window) {
+		size_type const opening = size + (dequeues - window);
+		size_type const windowPeak = std::max(peak, opening);
+		peak = opening;
+		if (windowPeak <= mark / ratio) {
+			mark = windowPeak;
+			trim = true;
+		}
+		else
+			mark = std::max(mark, windowPeak);
+	}
+	return trim;
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::fixed_priority_multi_queue(FORWARD beg, FORWARD end)
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+template <class FORWARD>
+fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::fixed_priority_multi_queue(FORWARD beg, FORWARD end, allocator_type const& alloc)
+	: queues(levels_allocator_type(alloc)) {
+	push_range(beg, end);
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::fixed_priority_multi_queue(snapshot)
+// Restores each level with one bulk copy where the level container supports append(). The policies then see
+// every restored element as a push, so their counters and timers start from the restore.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::fixed_priority_multi_queue(multi_queue_snapshot<ELEMENT_T> const& snapshot, allocator_type const& alloc)
+	: queues(levels_allocator_type(alloc)) {
+	grow(snapshot.level_count());
+	for (size_type p = 0; p < snapshot.level_count(); ++p) {
+		size_type const count = snapshot.level_size(p);
+		if (count == 0)
+			continue;
+
+		ELEMENT_T const* first = snapshot.level_data(p);
+		auto& q = queues[p];
+		if constexpr (has_level_append<LEVEL_T>::value)
+			q.append(first, first + count);
+		else
+			for (size_type i = 0; i < count; ++i)
+				q.push(first[i]);
+		occupied.set(p);
+
+		for (size_type depth = 1; depth <= count; ++depth) {
+			prepare_push(p);
+			++nElements;
+			record_push(p, depth);
+		}
+	}
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::pop()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::pop() noexcept {
+	if (nElements == 0)
+		return;
+
+	auto const priority = next_level();
+	auto& q = queues[priority];
+	schedule_policy().on_serve(priority, q.front());
+	q.pop();
+	--nElements;
+	record_pop(priority);
+	if (q.empty()) {
+		occupied.reset(priority);
+		schedule_policy().on_drain(priority);
+	}
+	age();
+	auto_trim();
+}
+
+
+
+// L-value fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push(value_type const& value, size_type priority) {
+	grow(priority + 1);
+
+	auto& q = queues[priority];
+	prepare_push(priority);
+	q.push(value);
+	occupied.set(priority);
+	++nElements;
+	record_push(priority, q.size());
+}
+
+
+
+// R-value fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push(value_type && value, size_type priority) {
+	grow(priority + 1);
+
+	auto& q = queues[priority];
+	prepare_push(priority);
+	q.push(std::move(value));
+	occupied.set(priority);
+	++nElements;
+	record_push(priority, q.size());
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::emplace()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+template <class... ARGS>
+typename fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::reference fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::emplace(size_type priority, ARGS&&... args) {
+	grow(priority + 1);
+
+	auto& q = queues[priority];
+	prepare_push(priority);
+	q.emplace(std::forward<ARGS>(args)...);
+	occupied.set(priority);
+	++nElements;
+	record_push(priority, q.size());
+	return q.back();
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::top()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+typename fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::reference fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::top() noexcept {
+	return queues[next_level()].front();
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::top()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+typename fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::const_reference fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::top() const noexcept {
+	return queues[next_level()].front();
+}
+
+
+
+// fixed_priority_multi_queue::operator = (copy)
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>& fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::operator = (fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T> const& other) {
+	STATS_T stats(other.stats_policy());
+	SCHEDULE_T schedule(other.schedule_policy());
+	AGING_T aging(other.aging());
+	TRIM_T trim(other.trimming());
+	queues = other.queues;
+	occupied = other.occupied;
+	nElements = other.nElements;
+	stats_policy() = std::move(stats);
+	schedule_policy() = std::move(schedule);
+	aging_policy() = std::move(aging);
+	trim_policy() = std::move(trim);
+	return *this;
+}
+
+
+
+// fixed_priority_multi_queue::operator = (move)
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>& fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::operator = (fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T> && other)
+	noexcept(levels_alloc_traits::propagate_on_container_move_assignment::value || levels_alloc_traits::is_always_equal::value) {
+	queues = std::move(other.queues);
+	occupied = std::move(other.occupied);
+	nElements = other.nElements;
+	stats_policy() = std::move(other.stats_policy());
+	schedule_policy() = std::move(other.schedule_policy());
+	aging_policy() = std::move(other.aging_policy());
+	trim_policy() = std::move(other.trim_policy());
+	other.queues.clear();
+	other.nElements = 0;
+	other.stats_policy().clear();
+	other.schedule_policy().clear();
+	other.aging_policy().clear();
+	other.trim_policy().clear();
+	return *this;
+}
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push_range(FORWARD first, FORWARD last, size_type priority)
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+template <class FORWARD>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push_range(FORWARD first, FORWARD last, size_type priority) {
+	if (first == last)
+		return;
+
+	grow(priority + 1);
+	auto& q = queues[priority];
+	if constexpr (has_level_reserve<LEVEL_T>::value && std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<FORWARD>::iterator_category>::value)
+		q.reserve(q.size() + static_cast<size_type>(std::distance(first, last)));
+
+	// the level is marked as soon as it holds an element, so a throwing copy leaves the pushed ones reachable
+	for (; first != last; ++first) {
+		prepare_push(priority);
+		q.emplace(*first);
+		occupied.set(priority);
+		++nElements;
+		record_push(priority, q.size());
+	}
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push_range(FORWARD first, FORWARD last)
+// Loads (value, priority) pairs. A counting pass sizes the levels up front, so the insertion pass neither
+// grows the level vector nor reallocates a level more than once.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+template <class FORWARD>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::push_range(FORWARD first, FORWARD last) {
+	if constexpr (!std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<FORWARD>::iterator_category>::value) {
+		for (; first != last; ++first) {
+			auto&& entry = *first;
+			emplace(entry.second, std::forward<decltype(entry)>(entry).first);
+		}
+	}
+	else {
+		// a move_iterator yields rvalue pairs, so their values are moved rather than copied
+		if (first == last)
+			return;
+
+		size_type levels = queues.size();
+		for (auto it = first; it != last; ++it)
+			levels = std::max(levels, static_cast<size_type>(it->second) + 1);
+		grow(levels);
+
+		if constexpr (has_level_reserve<LEVEL_T>::value) {
+			std::vector<size_type> counts(levels);
+			for (auto it = first; it != last; ++it)
+				++counts[it->second];
+			for (size_type p = 0; p < levels; ++p)
+				if (counts[p] != 0)
+					queues[p].reserve(queues[p].size() + counts[p]);
+		}
+
+		for (; first != last; ++first) {
+			auto&& entry = *first;
+			size_type const priority = entry.second;
+			auto& q = queues[priority];
+			prepare_push(priority);
+			q.emplace(std::forward<decltype(entry)>(entry).first);
+			occupied.set(priority);
+			++nElements;
+			record_push(priority, q.size());
+		}
+	}
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::try_pop()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+std::optional<typename fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::value_type> fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::try_pop() {
+	if (nElements == 0)
+		return std::nullopt;
+
+	auto const priority = next_level();
+	auto& q = queues[priority];
+	schedule_policy().on_serve(priority, q.front());
+	std::optional<value_type> value(std::move(q.front()));
+	q.pop();
+	--nElements;
+	record_pop(priority);
+	if (q.empty()) {
+		occupied.reset(priority);
+		schedule_policy().on_drain(priority);
+	}
+	age();
+	auto_trim();
+	return value;
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::try_pop(value_type&)
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+bool fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::try_pop(value_type& value) {
+	if (nElements == 0)
+		return false;
+
+	auto const priority = next_level();
+	auto& q = queues[priority];
+	schedule_policy().on_serve(priority, q.front());
+	value = std::move(q.front());
+	q.pop();
+	--nElements;
+	record_pop(priority);
+	if (q.empty()) {
+		occupied.reset(priority);
+		schedule_policy().on_drain(priority);
+	}
+	age();
+	auto_trim();
+	return true;
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::pop_n()
+// Moves up to n elements to out in dequeue order. Under strict priority each level is drained before the
+// next is located; other schedules are consulted again after every element, and aging runs once per element.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+template <class OUTPUT>
+OUTPUT fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::pop_n(OUTPUT out, size_type n) {
+	constexpr bool strict = std::is_same<SCHEDULE_T, strict_priority>::value;
+	constexpr bool aging = !std::is_same<AGING_T, no_aging>::value;
+	while (n != 0 && nElements != 0) {
+		auto const priority = next_level();
+		auto& q = queues[priority];
+		size_type dequeued = 0;
+		do {
+			schedule_policy().on_serve(priority, q.front());
+			*out = std::move(q.front());
+			++out;
+			q.pop();
+			--n;
+			--nElements;
+			++dequeued;
+			record_pop(priority);
+		} while (!aging && n != 0 && !q.empty() && (strict || next_level() == priority));
+		if (q.empty()) {
+			occupied.reset(priority);
+			schedule_policy().on_drain(priority);
+		}
+		age();
+		auto_trim(dequeued);
+	}
+	return out;
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::grow()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::grow(size_type levels) {
+	if (levels <= queues.size())
+		return;
+
+	stats_policy().on_grow(levels);
+	schedule_policy().on_grow(levels);
+	aging_policy().on_grow(levels);
+	queues.resize(levels);
+	occupied.resize(levels);
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::age()
+// Called after every dequeue: the aging policy checks one level, and up to its promotion limit of an expired
+// run is moved to the back of the level above, so the cost a dequeue pays is bounded. Promotion is best
+// effort; if the level above cannot make room, the run stays where it is and is found again later.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::age() noexcept {
+	auto const expired = aging_policy().expired(occupied);
+	size_type const from = expired.first;
+	size_type const count = expired.second;
+	if (count == 0)
+		return;
+
+	size_type const to = from - 1;
+	auto& source = queues[from];
+	auto& target = queues[to];
+	size_type moved = 0;
+	try {
+		stats_policy().prepare_transfer(to, count);
+		aging_policy().prepare_transfer(to);
+		if constexpr (has_level_handles<LEVEL_T>::value) {
+			// relink the nodes, so handles to the promoted elements stay valid
+			for (; moved != count; ++moved) {
+				handle const h = source.front_handle();
+				source.relink(h, target);
+				LEVEL_T::tag(h) = to;
+			}
+		}
+		else {
+			if constexpr (has_level_reserve<LEVEL_T>::value)
+				target.reserve(target.size() + count);
+			for (; moved != count; ++moved) {
+				target.push(std::move(source.front()));
+				source.pop();
+			}
+		}
+	}
+	catch (...) {
+		if (moved == 0)
+			return;
+	}
+
+	stats_policy().on_transfer(from, to, moved, target.size());
+	aging_policy().on_transfer(from, to, moved);
+	occupied.set(to);
+	if (source.empty()) {
+		occupied.reset(from);
+		schedule_policy().on_drain(from);
+	}
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::emplace_tracked()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+template <class... ARGS>
+typename fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::handle fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::emplace_tracked(size_type priority, ARGS&&... args) {
+	static_assert(has_level_handles<LEVEL_T>::value, "tracked elements need a level container with handles, such as linked_queue");
+	grow(priority + 1);
+	prepare_push(priority);
+	auto& q = queues[priority];
+	handle const h = q.emplace_tracked(std::forward<ARGS>(args)...);
+	LEVEL_T::tag(h) = priority;
+	occupied.set(priority);
+	++nElements;
+	record_push(priority, q.size());
+	return h;
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::erase()
+// Unlinks the element wherever it is in its level. The policies count it as erased rather than popped.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::erase(handle h) noexcept {
+	size_type const priority = LEVEL_T::tag(h);
+	auto& q = queues[priority];
+	q.erase(h);
+	--nElements;
+	stats_policy().on_erase(priority);
+	aging_policy().on_erase(priority);
+	if (q.empty()) {
+		occupied.reset(priority);
+		schedule_policy().on_drain(priority);
+	}
+	auto_trim();
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::change_priority()
+// Relinks the element to the back of its new level, as if it had been erased and pushed there, but without
+// moving it. Changing to the current priority leaves the element in place.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::change_priority(handle h, size_type priority) {
+	size_type const from = LEVEL_T::tag(h);
+	if (from == priority)
+		return;
+
+	grow(priority + 1);
+	prepare_push(priority);
+	auto& source = queues[from];
+	auto& target = queues[priority];
+	source.relink(h, target);
+	LEVEL_T::tag(h) = priority;
+	stats_policy().on_move(from);
+	aging_policy().on_erase(from);
+	occupied.set(priority);
+	if (source.empty()) {
+		occupied.reset(from);
+		schedule_policy().on_drain(from);
+	}
+	record_push(priority, target.size());
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::merge()
+// Splices every occupied level of other, leaving it empty. The cost is per level of other, plus the element
+// moves of levels that cannot be linked.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::merge(fixed_priority_multi_queue && other) {
+	if (this == &other || other.nElements == 0)
+		return;
+
+	grow(other.queues.size());
+	for (size_type p = other.occupied.find_first(); p != occupancy_bitmap::npos; p = other.occupied.find_next(p + 1))
+		splice_level(other, p);
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::splice()
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::splice(fixed_priority_multi_queue& other, size_type priority) {
+	if (this == &other || priority >= other.queues.size() || other.queues[priority].empty())
+		return;
+
+	grow(priority + 1);
+	splice_level(other, priority);
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::splice_level()
+// Appends other's level to ours. Should a move throw, the elements moved so far are settled here before the
+// exception propagates, so both queues stay consistent.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::splice_level(fixed_priority_multi_queue& other, size_type priority) {
+	auto& source = other.queues[priority];
+	auto& target = queues[priority];
+	size_type const count = source.size();
+	stats_policy().prepare_splice(priority, count);
+	aging_policy().prepare_splice(priority, other.aging_policy());
+
+	size_type const before = target.size();
+	try {
+		if constexpr (has_level_splice<LEVEL_T>::value)
+			target.splice(source);
+		else
+			for (; !source.empty(); source.pop())
+				target.push(std::move(source.front()));
+	}
+	catch (...) {
+		settle_splice(other, priority, target.size() - before);
+		throw;
+	}
+	settle_splice(other, priority, count);
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::settle_splice()
+// Hands the moved elements' policy state over from other and updates both queues' counts and occupancy.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::settle_splice(fixed_priority_multi_queue& other, size_type priority, size_type moved) noexcept {
+	if (moved == 0)
+		return;
+
+	stats_policy().on_splice(other.stats_policy(), priority, moved, queues[priority].size());
+	aging_policy().on_splice(other.aging_policy(), priority, moved);
+	nElements += moved;
+	other.nElements -= moved;
+	occupied.set(priority);
+	if (other.queues[priority].empty()) {
+		other.occupied.reset(priority);
+		other.schedule_policy().on_drain(priority);
+	}
+	trim_policy().on_push(nElements);
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::reserve()
+// Pre-warms the shared chunk pool for n more elements; level containers without a pool need no warm-up.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::reserve(size_type n) {
+	if constexpr (has_pool_reserve<allocator_type>::value)
+		get_allocator().reserve(nElements + n, queues.size());
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::shrink_to_fit()
+// Drained levels are replaced by freshly constructed ones, which own no storage, and the occupied levels are
+// moved across; levels that support it then shrink their own storage, and a pooling allocator frees the
+// chunks the old levels returned to it. Everything before the swap can fail without changing the queue.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::shrink_to_fit() {
+	size_type levels = queues.size();
+	while (levels > 0 && queues[levels - 1].empty())
+		--levels;
+
+	std::vector<LEVEL_T, levels_allocator_type> fresh(levels, queues.get_allocator());
+	occupied.shrink(levels);
+	for (size_type p = 0; p < levels; ++p)
+		if (!queues[p].empty()) {
+			using std::swap;
+			swap(fresh[p], queues[p]);
+		}
+	queues.swap(fresh);
+	fresh.clear();
+
+	stats_policy().on_shrink(levels);
+	schedule_policy().on_shrink(levels);
+	aging_policy().on_shrink(levels);
+	if constexpr (has_level_shrink<LEVEL_T>::value)
+		for (auto& q : queues)
+			q.shrink_to_fit();
+	if constexpr (has_pool_trim<allocator_type>::value)
+		get_allocator().trim();
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::save()
+// Writes the layout described at multi_queue_snapshot: header, level table, then each level's elements in
+// FIFO order, padded so every level starts on an aligned boundary. Empty levels are kept, so a restored
+// queue has the same max_priority().
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::save(std::ostream& out) const {
+	static_assert(has_level_spans<LEVEL_T>::value, "save() needs a level container with for_each_span(), such as ring_buffer");
+	using snapshot_type = multi_queue_snapshot<ELEMENT_T>;
+	using level_entry = typename snapshot_type::level_entry;
+
+	typename snapshot_type::header const header = snapshot_type::make_header(queues.size(), nElements);
+	std::vector<level_entry> table(queues.size());
+	std::uint64_t offset = snapshot_type::data_offset(queues.size());
+	for (size_type p = 0; p < queues.size(); ++p) {
+		table[p] = level_entry{ queues[p].size(), offset };
+		offset = snapshot_type::align(offset + queues[p].size() * sizeof(ELEMENT_T));
+	}
+
+	char const padding[snapshot_type::alignment] = {};
+	std::uint64_t written = 0;
+	auto write = [&](void const* data, std::uint64_t n) {
+		out.write(static_cast<char const*>(data), static_cast<std::streamsize>(n));
+		written += n;
+	};
+	auto pad = [&] { write(padding, snapshot_type::align(written) - written); };
+
+	write(&header, sizeof(header));
+	write(table.data(), table.size() * sizeof(level_entry));
+	pad();
+	for (auto const& q : queues) {
+		q.for_each_span([&](ELEMENT_T const* data, size_type count) { write(data, count * sizeof(ELEMENT_T)); });
+		pad();
+	}
+	if (!out)
+		throw std::runtime_error("fixed_priority_multi_queue::save: write failed");
+}
+
+
+
+// fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::auto_trim()
+// Called after every dequeue, or once for a batch of them. Like promotion, trimming is best effort: if the
+// smaller storage cannot be allocated, the queue keeps what it has.
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::auto_trim(size_type dequeued) noexcept {
+	if (!trim_policy().on_pop(nElements, dequeued))
+		return;
+
+	try {
+		shrink_to_fit();
+	}
+	catch (...) {
+	}
+}
+
+
+
+//Swap method implementation
+template <class ELEMENT_T, class LEVEL_T, class STATS_T, class SCHEDULE_T, class AGING_T, class TRIM_T>
+inline void fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, STATS_T, SCHEDULE_T, AGING_T, TRIM_T>::swap(fixed_priority_multi_queue& other) noexcept {
+	queues.swap(other.queues);
+	occupied.swap(other.occupied);
+	std::swap(nElements, other.nElements);
+	std::swap(stats_policy(), other.stats_policy());
+	std::swap(schedule_policy(), other.schedule_policy());
+	std::swap(aging_policy(), other.aging_policy());
+	std::swap(trim_policy(), other.trim_policy());
+}
+
+
+
+// atomic_occupancy_bitmap::atomic_occupancy_bitmap()
+inline atomic_occupancy_bitmap::atomic_occupancy_bitmap(size_type bits)
+	: nWords((bits + bits_per_word - 1) / bits_per_word)
+	, nSummaryWords((nWords + bits_per_word - 1) / bits_per_word)
+	, words(new std::atomic<word_type>[nWords])
+	, summary(new std::atomic<word_type>[nSummaryWords]) {
+	for (size_type i = 0; i < nWords; ++i)
+		words[i].store(0, std::memory_order_relaxed);
+	for (size_type i = 0; i < nSummaryWords; ++i)
+		summary[i].store(0, std::memory_order_relaxed);
+}
+
+
+
+// atomic_occupancy_bitmap::find_next()
+inline atomic_occupancy_bitmap::size_type atomic_occupancy_bitmap::find_next(size_type from) const noexcept {
+	size_type w = from / bits_per_word;
+	if (w >= nWords)
+		return npos;
+
+	word_type const first = words[w].load() & (~word_type(0) << (from % bits_per_word));
+	if (first != 0)
+		return w * bits_per_word + count_trailing_zeros(first);
+
+	++w;
+	for (size_type s = w / bits_per_word; s < nSummaryWords; ++s) {
+		word_type pending = summary[s].load();
+		if (s == w / bits_per_word)
+			pending &= ~word_type(0) << (w % bits_per_word);
+
+		// a summary bit can briefly outlive its word, so keep looking if the word is already empty
+		for (; pending != 0; pending &= pending - 1) {
+			size_type const w = s * bits_per_word + count_trailing_zeros(pending);
+			word_type const word = words[w].load();
+			if (word != 0)
+				return w * bits_per_word + count_trailing_zeros(word);
+		}
+	}
+
+	// reset() clears a summary bit before re-checking its word, so a set() racing with it can be missing from the
+	// summary for a moment; scan the words themselves before reporting nothing, or a waiter could miss its wakeup
+	for (; w < nWords; ++w) {
+		word_type const word = words[w].load();
+		if (word != 0)
+			return w * bits_per_word + count_trailing_zeros(word);
+	}
+	return npos;
+}
+
+
+
+// atomic_occupancy_bitmap::set()
+inline void atomic_occupancy_bitmap::set(size_type bit) noexcept {
+	size_type const w = bit / bits_per_word;
+	word_type const old = words[w].fetch_or(word_type(1) << (bit % bits_per_word));
+	if (old == 0)
+		summary[w / bits_per_word].fetch_or(word_type(1) << (w % bits_per_word));
+}
+
+
+
+// atomic_occupancy_bitmap::reset()
+inline void atomic_occupancy_bitmap::reset(size_type bit) noexcept {
+	size_type const w = bit / bits_per_word;
+	word_type const mask = word_type(1) << (bit % bits_per_word);
+	if (words[w].fetch_and(~mask) != mask)
+		return;
+
+	// the word went empty: clear its summary bit, then restore it if a set() slipped in meanwhile
+	word_type const summaryMask = word_type(1) << (w % bits_per_word);
+	summary[w / bits_per_word].fetch_and(~summaryMask);
+	if (words[w].load() != 0)
+		summary[w / bits_per_word].fetch_or(summaryMask);
+}
+
+
+
+// condition_wait::wait()
+template <class READY>
+bool condition_wait::wait(READY ready, wait_deadline const& deadline) {
+	if (ready())
+		return true;
+
+	// waiters register before their last ready(), so a producer that sees no waiter cannot strand one
+	std::unique_lock<std::mutex> guard(lock);
+	++nWaiters;
+	bool done;
+	while (!(done = ready()))
+		if (!deadline)
+			signal.wait(guard);
+		else if (signal.wait_until(guard, *deadline) == std::cv_status::timeout) {
+			done = ready();
+			break;
+		}
+	--nWaiters;
+	return done;
+}
+
+
+
+// condition_wait::notify_one()
+inline void condition_wait::notify_one() {
+	if (nWaiters.load() == 0)
+		return;
+
+	std::lock_guard<std::mutex> guard(lock);
+	signal.notify_one();
+}
+
+
+
+// condition_wait::notify_all()
+inline void condition_wait::notify_all() {
+	if (nWaiters.load() == 0)
+		return;
+
+	std::lock_guard<std::mutex> guard(lock);
+	signal.notify_all();
+}
+
+
+
+// busy_spin_wait::wait()
+template <class READY>
+bool busy_spin_wait::wait(READY ready, wait_deadline const& deadline) {
+	while (!ready()) {
+		if (deadline && std::chrono::steady_clock::now() >= *deadline)
+			return ready();
+		cpu_relax();
+	}
+	return true;
+}
+
+
+
+// spin_yield_wait<SPINS>::wait()
+template <unsigned SPINS>
+template <class READY>
+bool spin_yield_wait<SPINS>::wait(READY ready, wait_deadline const& deadline) {
+	for (unsigned spins = 0; !ready(); ++spins) {
+		if (deadline && std::chrono::steady_clock::now() >= *deadline)
+			return ready();
+		if (spins < SPINS)
+			cpu_relax();
+		else
+			std::this_thread::yield();
+	}
+	return true;
+}
+
+
+
+// futex_wait<MIN_SPINS, MAX_SPINS>::wait()
+// A sleeper registers before it reads the epoch and re-checks ready(), and a producer bumps the epoch before
+// it looks for sleepers, so either the sleeper sees the new element or the futex sees the new epoch.
+template <unsigned MIN_SPINS, unsigned MAX_SPINS>
+template <class READY>
+bool futex_wait<MIN_SPINS, MAX_SPINS>::wait(READY ready, wait_deadline const& deadline) {
+	unsigned const budget = spinBudget.load(std::memory_order_relaxed);
+	for (unsigned spins = 0; spins < budget; ++spins) {
+		if (ready()) {
+			if (spins != 0 && budget < MAX_SPINS)
+				spinBudget.store(std::min(budget * 2, MAX_SPINS), std::memory_order_relaxed);
+			return true;
+		}
+		cpu_relax();
+	}
+	if (budget > MIN_SPINS)
+		spinBudget.store(std::max(budget / 2, MIN_SPINS), std::memory_order_relaxed);
+
+	++nSleepers;
+	bool done;
+	for (;;) {
+		std::uint32_t const expected = epoch.load();
+		if ((done = ready()))
+			break;
+		if (deadline && std::chrono::steady_clock::now() >= *deadline) {
+			done = ready();
+			break;
+		}
+		sleep(expected, deadline);
+	}
+	--nSleepers;
+	return done;
+}
+
+
+
+// futex_wait<MIN_SPINS, MAX_SPINS>::sleep()
+// Returns when the epoch differs from expected, on a wake-up, at the deadline or spuriously.
+template <unsigned MIN_SPINS, unsigned MAX_SPINS>
+void futex_wait<MIN_SPINS, MAX_SPINS>::sleep(std::uint32_t expected, wait_deadline const& deadline) {
+#if defined(__linux__)
+	static_assert(sizeof(epoch) == sizeof(std::uint32_t), "the futex word must be a plain 32-bit integer");
+	timespec timeout{};
+	if (deadline) {
+		auto const left = std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline - std::chrono::steady_clock::now());
+		if (left.count() <= 0)
+			return;
+		timeout.tv_sec = static_cast<std::time_t>(left.count() / 1000000000);
+		timeout.tv_nsec = static_cast<long>(left.count() % 1000000000);
+	}
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&epoch), FUTEX_WAIT_PRIVATE, expected, deadline ? &timeout : nullptr, nullptr, 0);
+#else
+	std::unique_lock<std::mutex> guard(lock);
+	if (epoch.load() != expected)
+		return;
+	if (deadline)
+		signal.wait_until(guard, *deadline);
+	else
+		signal.wait(guard);
+#endif
+}
+
+
+
+// futex_wait<MIN_SPINS, MAX_SPINS>::wake()
+template <unsigned MIN_SPINS, unsigned MAX_SPINS>
+void futex_wait<MIN_SPINS, MAX_SPINS>::wake(bool all) noexcept {
+	if (nSleepers.load() == 0)
+		return;
+
+	++epoch;
+#if defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&epoch), FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+	std::lock_guard<std::mutex> guard(lock);
+	if (all)
+		signal.notify_all();
+	else
+		signal.notify_one();
+#endif
+}
+
+
+
+// concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::concurrent_fixed_priority_multi_queue()
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::concurrent_fixed_priority_multi_queue(size_type max_priority)
+	: nLevels(max_priority), levels(new level[max_priority]), occupied(max_priority) {
+}
+
+
+
+// concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::close()
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+void concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::close() {
+	closed.store(true);
+	waiting.notify_all();
+}
+
+
+
+// L-value concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::push()
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+bool concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::push(value_type const& value, size_type priority) {
+	return push_value(value, priority);
+}
+
+
+
+// R-value concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::push()
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+bool concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::push(value_type && value, size_type priority) {
+	return push_value(std::move(value), priority);
+}
+
+
+
+// concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::push_value()
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+template <class VALUE>
+bool concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::push_value(VALUE&& value, size_type priority) {
+	if (priority >= nLevels)
+		throw std::out_of_range("concurrent_fixed_priority_multi_queue::push: priority out of range");
+	if (closed.load())
+		return false;
+
+	{
+		level& l = levels[priority];
+		std::lock_guard<std::mutex> guard(l.lock);
+		l.items.push(std::forward<VALUE>(value));
+		if (l.items.size() == 1)
+			occupied.set(priority);
+		++nElements;
+	}
+
+	// a waiter limited to better priorities may take the single notification and ignore the element
+	if (nLimitedWaiters.load() != 0)
+		waiting.notify_all();
+	else
+		waiting.notify_one();
+	return true;
+}
+
+
+
+// concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::try_pop_within()
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+bool concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::try_pop_within(value_type& value, size_type priority) {
+	for (;;) {
+		size_type const first = occupied.find_first();
+		if (first == atomic_occupancy_bitmap::npos || first > priority)
+			return false;
+
+		level& l = levels[first];
+		std::lock_guard<std::mutex> guard(l.lock);
+		if (l.items.empty())
+			continue;	// another consumer drained it first
+
+		value = std::move(l.items.front());
+		l.items.pop();
+		if (l.items.empty())
+			occupied.reset(first);
+		--nElements;
+		return true;
+	}
+}
+
+
+
+// concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::wait_pop(timeout)
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+template <class REP, class PERIOD>
+bool concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::wait_pop(value_type& value, std::chrono::duration<REP, PERIOD> const& timeout) {
+	return wait_pop_until(value, atomic_occupancy_bitmap::npos, std::chrono::steady_clock::now() + timeout);
+}
+
+
+
+// concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::wait_pop_within(timeout)
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+template <class REP, class PERIOD>
+bool concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::wait_pop_within(value_type& value, size_type priority, std::chrono::duration<REP, PERIOD> const& timeout) {
+	return wait_pop_until(value, priority, std::chrono::steady_clock::now() + timeout);
+}
+
+
+
+// concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::wait_pop_until()
+// Pops an element at priority or better, waiting for one until the deadline or until the queue is closed.
+template <class ELEMENT_T, class LEVEL_T, class LAYOUT_T, class WAIT_T>
+bool concurrent_fixed_priority_multi_queue<ELEMENT_T, LEVEL_T, LAYOUT_T, WAIT_T>::wait_pop_until(value_type& value, size_type priority, wait_deadline const& deadline) {
+	if (try_pop_within(value, priority))
+		return true;
+
+	bool const limited = priority + 1 < nLevels;
+	if (limited)
+		++nLimitedWaiters;
+	bool popped = false;
+	waiting.wait([&] { return (popped = try_pop_within(value, priority)) || closed.load(); }, deadline);
+	if (limited)
+		--nLimitedWaiters;
+	return popped;
+}
+
+
+
+// bounded_mpmc_ring<ELEMENT_T>::bounded_mpmc_ring()
+template <class ELEMENT_T>
+bounded_mpmc_ring<ELEMENT_T>::bounded_mpmc_ring(size_type capacity) {
+	size_type rounded = 2;
+	while (rounded < capacity)
+		rounded *= 2;
+
+	mask = rounded - 1;
+	cells.reset(new cell[rounded]);
+	for (size_type i = 0; i < rounded; ++i)
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+
+
+// bounded_mpmc_ring<ELEMENT_T>::~bounded_mpmc_ring()
+template <class ELEMENT_T>
+bounded_mpmc_ring<ELEMENT_T>::~bounded_mpmc_ring() {
+	for (size_type pos = dequeuePos.load(); pos != enqueuePos.load(); ++pos)
+		reinterpret_cast<ELEMENT_T*>(cells[pos & mask].storage)->~ELEMENT_T();
+}
+
+
+
+// bounded_mpmc_ring<ELEMENT_T>::try_push()
+// A construction that may throw is done into a local first; once the cell is claimed, only a nothrow move is left.
+template <class ELEMENT_T>
+template <class VALUE>
+bool bounded_mpmc_ring<ELEMENT_T>::try_push(VALUE&& value) {
+	if constexpr (!std::is_nothrow_constructible<ELEMENT_T, VALUE&&>::value)
+		return try_push(ELEMENT_T(std::forward<VALUE>(value)));
+
+	size_type pos = enqueuePos.load(std::memory_order_relaxed);
+	cell* target;
+	for (;;) {
+		target = &cells[pos & mask];
+		auto const diff = static_cast<std::ptrdiff_t>(target->sequence.load(std::memory_order_acquire) - pos);
+		if (diff == 0) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+			return false;	// the cell still holds the element from one lap ago
+		else
+			pos = enqueuePos.load(std::memory_order_relaxed);
+	}
+
+	new (target->storage) ELEMENT_T(std::forward<VALUE>(value));
+	target->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+
+
+// bounded_mpmc_ring<ELEMENT_T>::try_pop()
+template <class ELEMENT_T>
+bool bounded_mpmc_ring<ELEMENT_T>::try_pop(value_type& value) {
+	size_type pos = dequeuePos.load(std::memory_order_relaxed);
+	cell* source;
+	for (;;) {
+		source = &cells[pos & mask];
+		auto const diff = static_cast<std::ptrdiff_t>(source->sequence.load(std::memory_order_acquire) - (pos + 1));
+		if (diff == 0) {
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+			return false;	// nothing published in this cell yet
+		else
+			pos = dequeuePos.load(std::memory_order_relaxed);
+	}
+
+	auto element = reinterpret_cast<ELEMENT_T*>(source->storage);
+	value = std::move(*element);
+	element->~ELEMENT_T();
+	source->sequence.store(pos + mask + 1, std::memory_order_release);
+	return true;
+}
+
+
+
+// lock_free_fixed_priority_multi_queue<ELEMENT_T>::lock_free_fixed_priority_multi_queue()
+template <class ELEMENT_T>
+lock_free_fixed_priority_multi_queue<ELEMENT_T>::lock_free_fixed_priority_multi_queue(size_type max_priority, size_type capacity)
+	: occupied(max_priority) {
+	levels.reserve(max_priority);
+	for (size_type i = 0; i < max_priority; ++i)
+		levels.push_back(std::make_unique<bounded_mpmc_ring<ELEMENT_T>>(capacity));
+}
+
+
+
+// L-value lock_free_fixed_priority_multi_queue<ELEMENT_T>::try_push()
+template <class ELEMENT_T>
+bool lock_free_fixed_priority_multi_queue<ELEMENT_T>::try_push(value_type const& value, size_type priority) {
+	return push_value(value, priority);
+}
+
+
+
+// R-value lock_free_fixed_priority_multi_queue<ELEMENT_T>::try_push()
+template <class ELEMENT_T>
+bool lock_free_fixed_priority_multi_queue<ELEMENT_T>::try_push(value_type && value, size_type priority) {
+	return push_value(std::move(value), priority);
+}
+
+
+
+// lock_free_fixed_priority_multi_queue<ELEMENT_T>::push_value()
+template <class ELEMENT_T>
+template <class VALUE>
+bool lock_free_fixed_priority_multi_queue<ELEMENT_T>::push_value(VALUE&& value, size_type priority) {
+	if (priority >= levels.size())
+		throw std::out_of_range("lock_free_fixed_priority_multi_queue::try_push: priority out of range");
+
+	// count first so that a racing try_pop() can never drive the counter below zero; a copy that throws
+	// leaves the ring untouched, so only the count needs taking back
+	++nElements;
+	bool pushed;
+	try {
+		pushed = levels[priority]->try_push(std::forward<VALUE>(value));
+	}
+	catch (...) {
+		--nElements;
+		throw;
+	}
+	if (!pushed) {
+		--nElements;
+		return false;
+	}
+
+	// always set the bit, even when it looks set: try_push() publishes through a relaxed CAS, so a plain test()
+	// may read a stale bit while refresh() concurrently clears it after missing our element. The seq_cst
+	// read-modify-write here and the seq_cst reset()/empty() pair in refresh() are totally ordered, so either
+	// refresh() sees the element or this set() lands after its reset()
+	occupied.set(priority);
+	return true;
+}
+
+
+
+// lock_free_fixed_priority_multi_queue<ELEMENT_T>::try_pop()
+template <class ELEMENT_T>
+bool lock_free_fixed_priority_multi_queue<ELEMENT_T>::try_pop(value_type& value) {
+	// a level whose head is still being published is passed over rather than waited on
+	for (auto priority = occupied.find_first(); priority != atomic_occupancy_bitmap::npos; priority = occupied.find_next(priority + 1)) {
+		bool const popped = levels[priority]->try_pop(value);
+		if (popped)
+			--nElements;
+		refresh(priority);
+		if (popped)
+			return true;
+	}
+	return false;
+}
+
+
+
+// lock_free_fixed_priority_multi_queue<ELEMENT_T>::refresh()
+template <class ELEMENT_T>
+void lock_free_fixed_priority_multi_queue<ELEMENT_T>::refresh(size_type priority) noexcept {
+	if (!levels[priority]->empty())
+		return;
+
+	// a producer that pushed after the emptiness check either sees the cleared bit or is seen by the re-check
+	occupied.reset(priority);
+	if (!levels[priority]->empty())
+		occupied.set(priority);
+}
+
+
+
+// stealing_shard<ELEMENT_T, LEVEL_T>::stealing_shard()
+template <class ELEMENT_T, class LEVEL_T>
+stealing_shard<ELEMENT_T, LEVEL_T>::stealing_shard(size_type max_priority, size_type window_capacity)
+	: window(max_priority, window_capacity), spilled(max_priority, 0) {
+}
+
+
+
+// stealing_shard<ELEMENT_T, LEVEL_T>::top_priority()
+// The owner's view: the better of the window's hint and the backlog's top.
+template <class ELEMENT_T, class LEVEL_T>
+typename stealing_shard<ELEMENT_T, LEVEL_T>::size_type stealing_shard<ELEMENT_T, LEVEL_T>::top_priority() const noexcept {
+	size_type const shared = window.top_priority();
+	return backlog.empty() ? shared : std::min(shared, backlog.top_priority());
+}
+
+
+
+// stealing_shard<ELEMENT_T, LEVEL_T>::push()
+// The element is built once; a full window level leaves it untouched for the backlog.
+template <class ELEMENT_T, class LEVEL_T>
+template <class VALUE>
+void stealing_shard<ELEMENT_T, LEVEL_T>::push(VALUE&& value, size_type priority) {
+	ELEMENT_T element(std::forward<VALUE>(value));
+
+	// count first so that a thief taking the element at once can never drive the counter below zero
+	nElements.fetch_add(1, std::memory_order_relaxed);
+	try {
+		if (spilled[priority] == 0 && window.try_push(std::move(element), priority))
+			return;
+		backlog.push(std::move(element), priority);
+		++spilled[priority];
+	}
+	catch (...) {
+		nElements.fetch_sub(1, std::memory_order_relaxed);
+		throw;
+	}
+}
+
+
+
+// stealing_shard<ELEMENT_T, LEVEL_T>::pop()
+// The backlog only goes first when its top level is better than anything in the window; on a tie the
+// window holds the older elements of the level.
+template <class ELEMENT_T, class LEVEL_T>
+bool stealing_shard<ELEMENT_T, LEVEL_T>::pop(ELEMENT_T& value) {
+	bool const fromBacklog = !backlog.empty() && backlog.top_priority() < window.top_priority();
+	if (fromBacklog || !window.try_pop(value)) {
+		if (backlog.empty())
+			return false;
+		--spilled[backlog.top_priority()];
+		value = std::move(backlog.top());
+		backlog.pop();
+	}
+	nElements.fetch_sub(1, std::memory_order_relaxed);
+	refill();
+	return true;
+}
+
+
+
+// stealing_shard<ELEMENT_T, LEVEL_T>::steal()
+template <class ELEMENT_T, class LEVEL_T>
+bool stealing_shard<ELEMENT_T, LEVEL_T>::steal(ELEMENT_T& value) {
+	if (!window.try_pop(value))
+		return false;
+
+	nElements.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+
+
+// stealing_shard<ELEMENT_T, LEVEL_T>::refill()
+// Moves backlog elements into the window, best level first, until a level is full. Each element moves at
+// most once, so the cost is amortized over the pushes that spilled it.
+template <class ELEMENT_T, class LEVEL_T>
+void stealing_shard<ELEMENT_T, LEVEL_T>::refill() noexcept {
+	while (!backlog.empty()) {
+		size_type const priority = backlog.top_priority();
+		if (!window.try_push(std::move(backlog.top()), priority))
+			return;
+		backlog.pop();
+		--spilled[priority];
+	}
+}
+
+
+
+// sharded_multi_queue<ELEMENT_T, LEVEL_T>::sharded_multi_queue()
+template <class ELEMENT_T, class LEVEL_T>
+sharded_multi_queue<ELEMENT_T, LEVEL_T>::sharded_multi_queue(size_type shard_count, size_type relaxation, size_type max_priority, size_type window_capacity)
+	: nLevels(max_priority), relaxation(relaxation) {
+	if (shard_count == 0)
+		throw std::invalid_argument("sharded_multi_queue needs at least one shard");
+
+	shards.reserve(shard_count);
+	for (size_type i = 0; i < shard_count; ++i)
+		shards.push_back(std::make_unique<shard>(max_priority, window_capacity));
+}
+
+
+
+// sharded_multi_queue<ELEMENT_T, LEVEL_T>::empty()
+template <class ELEMENT_T, class LEVEL_T>
+bool sharded_multi_queue<ELEMENT_T, LEVEL_T>::empty() const noexcept {
+	for (auto const& s : shards)
+		if (s->nElements.load(std::memory_order_relaxed) != 0)
+			return false;
+	return true;
+}
+
+
+
+// sharded_multi_queue<ELEMENT_T, LEVEL_T>::size()
+template <class ELEMENT_T, class LEVEL_T>
+typename sharded_multi_queue<ELEMENT_T, LEVEL_T>::size_type sharded_multi_queue<ELEMENT_T, LEVEL_T>::size() const noexcept {
+	size_type total = 0;
+	for (auto const& s : shards)
+		total += s->nElements.load(std::memory_order_relaxed);
+	return total;
+}
+
+
+
+// L-value sharded_multi_queue<ELEMENT_T, LEVEL_T>::push()
+template <class ELEMENT_T, class LEVEL_T>
+void sharded_multi_queue<ELEMENT_T, LEVEL_T>::push(size_type shard, value_type const& value, size_type priority) {
+	push_value(shard, value, priority);
+}
+
+
+
+// R-value sharded_multi_queue<ELEMENT_T, LEVEL_T>::push()
+template <class ELEMENT_T, class LEVEL_T>
+void sharded_multi_queue<ELEMENT_T, LEVEL_T>::push(size_type shard, value_type && value, size_type priority) {
+	push_value(shard, std::move(value), priority);
+}
+
+
+
+// sharded_multi_queue<ELEMENT_T, LEVEL_T>::push_value()
+template <class ELEMENT_T, class LEVEL_T>
+template <class VALUE>
+void sharded_multi_queue<ELEMENT_T, LEVEL_T>::push_value(size_type shard, VALUE&& value, size_type priority) {
+	if (shard >= shards.size())
+		throw std::out_of_range("sharded_multi_queue::push: shard out of range");
+	if (priority >= nLevels)
+		throw std::out_of_range("sharded_multi_queue::push: priority out of range");
+
+	auto& s = *shards[shard];
+	s.refill();
+	s.push(std::forward<VALUE>(value), priority);
+}
+
+
+
+// sharded_multi_queue<ELEMENT_T, LEVEL_T>::try_pop()
+// Picks a victim from the windows, then falls back to the local shard and finally to any window with work.
+// Every step is a lock-free ring pop, except for the owner's own backlog.
+template <class ELEMENT_T, class LEVEL_T>
+bool sharded_multi_queue<ELEMENT_T, LEVEL_T>::try_pop(size_type shard, value_type& value) {
+	size_type const nShards = shards.size();
+	if (shard >= nShards)
+		throw std::out_of_range("sharded_multi_queue::try_pop: shard out of range");
+
+	auto& local = *shards[shard];
+	local.refill();
+	size_type const own = local.top_priority();
+
+	size_type victim = shard;
+	size_type best = own;
+	for (size_type i = shard + 1; i != shard + nShards; ++i) {
+		size_type const other = i < nShards ? i : i - nShards;
+		size_type const top = shards[other]->window.top_priority();
+		if (top < best && (own == npos || own - top > relaxation)) {
+			best = top;
+			victim = other;
+		}
+	}
+
+	if (victim != shard && shards[victim]->steal(value))
+		return true;
+
+	if (own != npos && local.pop(value))
+		return true;
+
+	for (size_type i = shard + 1; i != shard + nShards; ++i) {
+		auto& other = *shards[i < nShards ? i : i - nShards];
+		if (!other.window.empty() && other.steal(value))
+			return true;
+	}
+	return false;
+}
+
+
+
+// relaxed_multi_queue<ELEMENT_T, LEVEL_T>::relaxed_multi_queue()
+template <class ELEMENT_T, class LEVEL_T>
+relaxed_multi_queue<ELEMENT_T, LEVEL_T>::relaxed_multi_queue(size_type threads, size_type c)
+	: nQueues(threads * c), queues(new shard[threads * c]) {
+	if (nQueues == 0)
+		throw std::invalid_argument("relaxed_multi_queue needs at least one thread and c > 0");
+}
+
+
+
+// relaxed_multi_queue<ELEMENT_T, LEVEL_T>::empty()
+template <class ELEMENT_T, class LEVEL_T>
+bool relaxed_multi_queue<ELEMENT_T, LEVEL_T>::empty() const noexcept {
+	for (size_type i = 0; i < nQueues; ++i)
+		if (queues[i].nElements.load(std::memory_order_relaxed) != 0)
+			return false;
+	return true;
+}
+
+
+
+// relaxed_multi_queue<ELEMENT_T, LEVEL_T>::size()
+template <class ELEMENT_T, class LEVEL_T>
+typename relaxed_multi_queue<ELEMENT_T, LEVEL_T>::size_type relaxed_multi_queue<ELEMENT_T, LEVEL_T>::size() const noexcept {
+	size_type total = 0;
+	for (size_type i = 0; i < nQueues; ++i)
+		total += queues[i].nElements.load(std::memory_order_relaxed);
+	return total;
+}
+
+
+
+// L-value relaxed_multi_queue<ELEMENT_T, LEVEL_T>::push()
+template <class ELEMENT_T, class LEVEL_T>
+void relaxed_multi_queue<ELEMENT_T, LEVEL_T>::push(value_type const& value, size_type priority) {
+	push_value(value, priority);
+}
+
+
+
+// R-value relaxed_multi_queue<ELEMENT_T, LEVEL_T>::push()
+template <class ELEMENT_T, class LEVEL_T>
+void relaxed_multi_queue<ELEMENT_T, LEVEL_T>::push(value_type && value, size_type priority) {
+	push_value(std::move(value), priority);
+}
+
+
+
+// relaxed_multi_queue<ELEMENT_T, LEVEL_T>::push_value()
+template <class ELEMENT_T, class LEVEL_T>
+template <class VALUE>
+void relaxed_multi_queue<ELEMENT_T, LEVEL_T>::push_value(VALUE&& value, size_type priority) {
+	for (;;) {
+		auto& s = queues[random_queue()];
+		std::unique_lock<std::mutex> guard(s.lock, std::try_to_lock);
+		if (guard.owns_lock()) {
+			s.push(std::forward<VALUE>(value), priority);
+			return;
+		}
+	}
+}
+
+
+
+// relaxed_multi_queue<ELEMENT_T, LEVEL_T>::try_pop()
+// Two random choices, the better advertised top wins. When both look empty the queue is only reported empty
+// after every instance has been checked.
+template <class ELEMENT_T, class LEVEL_T>
+bool relaxed_multi_queue<ELEMENT_T, LEVEL_T>::try_pop(value_type& value) {
+	for (;;) {
+		auto& first = queues[random_queue()];
+		auto& second = queues[random_queue()];
+		size_type const firstTop = first.top.load(std::memory_order_relaxed);
+		size_type const secondTop = second.top.load(std::memory_order_relaxed);
+		if (firstTop == npos && secondTop == npos) {
+			if (empty())
+				return false;
+			continue;
+		}
+
+		auto& best = secondTop < firstTop ? second : first;
+		std::unique_lock<std::mutex> guard(best.lock, std::try_to_lock);
+		if (guard.owns_lock() && best.pop(value))
+			return true;
+	}
+}
+
+
+
+// relaxed_multi_queue<ELEMENT_T, LEVEL_T>::random_queue()
+// Per-thread xorshift generator, seeded from the address of its thread-local state.
+template <class ELEMENT_T, class LEVEL_T>
+typename relaxed_multi_queue<ELEMENT_T, LEVEL_T>::size_type relaxed_multi_queue<ELEMENT_T, LEVEL_T>::random_queue() const noexcept {
+	thread_local std::uint64_t state = 0;
+	if (state == 0)
+		state = (reinterpret_cast<std::uintptr_t>(&state) * 0x9E3779B97F4A7C15ull) | 1;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return static_cast<size_type>(state % nQueues);
+}
+
+
+
+// locked_shard<ELEMENT_T, LEVEL_T>::push()
+template <class ELEMENT_T, class LEVEL_T>
+template <class VALUE>
+void locked_shard<ELEMENT_T, LEVEL_T>::push(VALUE&& value, size_type priority) {
+	items.push(std::forward<VALUE>(value), priority);
+	nElements.fetch_add(1, std::memory_order_relaxed);
+	publish();
+}
+
+
+
+// locked_shard<ELEMENT_T, LEVEL_T>::pop()
+template <class ELEMENT_T, class LEVEL_T>
+bool locked_shard<ELEMENT_T, LEVEL_T>::pop(ELEMENT_T& value) {
+	if (!items.try_pop(value))
+		return false;
+
+	nElements.fetch_sub(1, std::memory_order_relaxed);
+	publish();
+	return true;
+}
+
+
+
+// locked_shard<ELEMENT_T, LEVEL_T>::publish()
+// The hint is only written when the top priority changes, so its cache line stays shared between the
+// threads reading it while a shard works through one level.
+template <class ELEMENT_T, class LEVEL_T>
+void locked_shard<ELEMENT_T, LEVEL_T>::publish() noexcept {
+	size_type const priority = items.empty() ? npos : items.top_priority();
+	if (top.load(std::memory_order_relaxed) != priority)
+		top.store(priority, std::memory_order_release);
+}
+
+
+
+// static_multi_queue<ELEMENT_T, N, LEVEL_T>::first_occupied()
+template <class ELEMENT_T, std::size_t N, class LEVEL_T>
+template <std::size_t... WORD>
+typename static_multi_queue<ELEMENT_T, N, LEVEL_T>::size_type static_multi_queue<ELEMENT_T, N, LEVEL_T>::first_occupied(std::index_sequence<WORD...>) const noexcept {
+	if constexpr (nWords == 1)
+		return count_trailing_zeros(occupied[0]);
+	else {
+		// one test per word, expanded at compile time and stopped at the first non-empty word
+		size_type priority = 0;
+		(void)((occupied[WORD] != 0 ? (priority = WORD * bits_per_word + count_trailing_zeros(occupied[WORD]), true) : false) || ...);
+		return priority;
+	}
+}
+
+
+
+// static_multi_queue<ELEMENT_T, N, LEVEL_T>::pop()
+template <class ELEMENT_T, std::size_t N, class LEVEL_T>
+void static_multi_queue<ELEMENT_T, N, LEVEL_T>::pop() noexcept {
+	auto const priority = first_occupied();
+	auto& q = queues[priority];
+	q.pop();
+	--nElements;
+	if (q.empty())
+		occupied[priority / bits_per_word] &= ~(word_type(1) << (priority % bits_per_word));
+}
+
+
+
+// L-value static_multi_queue<ELEMENT_T, N, LEVEL_T>::push()
+template <class ELEMENT_T, std::size_t N, class LEVEL_T>
+void static_multi_queue<ELEMENT_T, N, LEVEL_T>::push(value_type const& value, size_type priority) {
+	assert(priority < N);
+	queues[priority].push(value);
+	mark_occupied(priority);
+	++nElements;
+}
+
+
+
+// R-value static_multi_queue<ELEMENT_T, N, LEVEL_T>::push()
+template <class ELEMENT_T, std::size_t N, class LEVEL_T>
+void static_multi_queue<ELEMENT_T, N, LEVEL_T>::push(value_type && value, size_type priority) {
+	assert(priority < N);
+	queues[priority].push(std::move(value));
+	mark_occupied(priority);
+	++nElements;
+}
+
+
+
+// static_multi_queue<ELEMENT_T, N, LEVEL_T>::emplace()
+template <class ELEMENT_T, std::size_t N, class LEVEL_T>
+template <class... ARGS>
+typename static_multi_queue<ELEMENT_T, N, LEVEL_T>::reference static_multi_queue<ELEMENT_T, N, LEVEL_T>::emplace(size_type priority, ARGS&&... args) {
+	assert(priority < N);
+	auto& q = queues[priority];
+	q.emplace(std::forward<ARGS>(args)...);
+	mark_occupied(priority);
+	++nElements;
+	return q.back();
+}
+
+
+
+// static_multi_queue<ELEMENT_T, N, LEVEL_T>::swap()
+template <class ELEMENT_T, std::size_t N, class LEVEL_T>
+inline void static_multi_queue<ELEMENT_T, N, LEVEL_T>::swap(static_multi_queue& other) noexcept {
+	std::swap(queues, other.queues);
+	std::swap(occupied, other.occupied);
+	std::swap(nElements, other.nElements);
+}
+
+
+
+// sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::emplace()
+// A level opened for this element is closed again if constructing the element throws.
+template <class ELEMENT_T, class LEVEL_T>
+template <class... ARGS>
+typename sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::reference sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::emplace(size_type priority, ARGS&&... args) {
+	auto at = std::lower_bound(index.begin(), index.end(), priority,
+		[](entry const& e, size_type key) { return e.priority < key; });
+	if (at != index.end() && at->priority == priority) {
+		auto& q = levels[at->slot];
+		q.emplace(std::forward<ARGS>(args)...);
+		++nElements;
+		return q.back();
+	}
+
+	size_type const slot = acquire_slot();
+	try {
+		at = index.insert(at, entry{ priority, slot });
+	}
+	catch (...) {
+		spare.push_back(slot);
+		throw;
+	}
+
+	auto& q = levels[slot];
+	try {
+		q.emplace(std::forward<ARGS>(args)...);
+	}
+	catch (...) {
+		index.erase(at);
+		spare.push_back(slot);
+		throw;
+	}
+	++nElements;
+	return q.back();
+}
+
+
+
+// sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::pop()
+template <class ELEMENT_T, class LEVEL_T>
+void sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::pop() noexcept {
+	auto const slot = index.front().slot;
+	auto& q = levels[slot];
+	q.pop();
+	--nElements;
+	if (q.empty()) {
+		spare.push_back(slot);
+		index.pop_front();
+	}
+}
+
+
+
+// sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::try_pop()
+template <class ELEMENT_T, class LEVEL_T>
+std::optional<typename sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::value_type> sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::try_pop() {
+	if (nElements == 0)
+		return std::nullopt;
+
+	std::optional<value_type> value(std::move(top()));
+	pop();
+	return value;
+}
+
+
+
+// sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::try_pop(value_type&)
+template <class ELEMENT_T, class LEVEL_T>
+bool sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::try_pop(value_type& value) {
+	if (nElements == 0)
+		return false;
+
+	value = std::move(top());
+	pop();
+	return true;
+}
+
+
+
+// sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::swap()
+template <class ELEMENT_T, class LEVEL_T>
+void sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::swap(sparse_priority_multi_queue& other) noexcept {
+	index.swap(other.index);
+	levels.swap(other.levels);
+	spare.swap(other.spare);
+	std::swap(nElements, other.nElements);
+}
+
+
+
+// sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::shrink_to_fit()
+// Compacts the occupied levels into slots 0 to level_count() - 1 and frees the spare slots with their storage.
+template <class ELEMENT_T, class LEVEL_T>
+void sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::shrink_to_fit() {
+	std::vector<LEVEL_T> compact(index.size());
+	std::vector<size_type> room;
+	room.reserve(index.size());
+	for (size_type i = 0; i < index.size(); ++i) {
+		using std::swap;
+		swap(compact[i], levels[index[i].slot]);
+		index[i].slot = i;
+	}
+	levels.swap(compact);
+	spare.swap(room);
+
+	if constexpr (has_level_shrink<LEVEL_T>::value)
+		for (auto& q : levels)
+			q.shrink_to_fit();
+}
+
+
+
+// sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::acquire_slot()
+// The spare list keeps room for every slot, so handing a slot back never allocates.
+template <class ELEMENT_T, class LEVEL_T>
+typename sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::size_type sparse_priority_multi_queue<ELEMENT_T, LEVEL_T>::acquire_slot() {
+	if (!spare.empty()) {
+		size_type const slot = spare.back();
+		spare.pop_back();
+		return slot;
+	}
+
+	if (spare.capacity() <= levels.size())
+		spare.reserve(std::max<size_type>(2 * levels.size(), 8));
+	levels.emplace_back();
+	return levels.size() - 1;
+}
+
+
+
+// multi_queue_snapshot<ELEMENT_T>::multi_queue_snapshot()
+// The file is mapped read-only where mmap is available, else read into memory. Either way it is validated
+// before any level is handed out.
+template <class ELEMENT_T>
+multi_queue_snapshot<ELEMENT_T>::multi_queue_snapshot(char const* path) {
+	static_assert(std::is_trivially_copyable<ELEMENT_T>::value, "snapshots store elements as raw bytes");
+#if defined(__unix__) || defined(__APPLE__)
+	int const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw std::runtime_error("multi_queue_snapshot: cannot open the file");
+
+	struct stat status;
+	if (::fstat(fd, &status) != 0) {
+		::close(fd);
+		throw std::runtime_error("multi_queue_snapshot: cannot read the file");
+	}
+	nBytes = static_cast<size_type>(status.st_size);
+	if (nBytes != 0) {
+		void* mapping = ::mmap(nullptr, nBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			::close(fd);
+			throw std::runtime_error("multi_queue_snapshot: cannot map the file");
+		}
+		// start reading the whole file ahead of the level copies
+		::madvise(mapping, nBytes, MADV_WILLNEED);
+		bytes = static_cast<unsigned char const*>(mapping);
+	}
+	::close(fd);
+#else
+	std::FILE* file = std::fopen(path, "rb");
+	if (!file)
+		throw std::runtime_error("multi_queue_snapshot: cannot open the file");
+
+	long length = -1;
+	if (std::fseek(file, 0, SEEK_END) == 0)
+		length = std::ftell(file);
+	if (length < 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+		std::fclose(file);
+		throw std::runtime_error("multi_queue_snapshot: cannot read the file");
+	}
+	nBytes = static_cast<size_type>(length);
+	contents.reset(new unsigned char[nBytes]);
+	bool const complete = std::fread(contents.get(), 1, nBytes, file) == nBytes;
+	std::fclose(file);
+	if (!complete)
+		throw std::runtime_error("multi_queue_snapshot: cannot read the file");
+	bytes = contents.get();
+#endif
+
+	try {
+		validate();
+	}
+	catch (...) {
+		release();
+		throw;
+	}
+}
+
+
+
+// multi_queue_snapshot<ELEMENT_T>::multi_queue_snapshot(move)
+template <class ELEMENT_T>
+multi_queue_snapshot<ELEMENT_T>::multi_queue_snapshot(multi_queue_snapshot && other) noexcept
+	: bytes(other.bytes), nBytes(other.nBytes), contents(std::move(other.contents)) {
+	other.bytes = nullptr;
+	other.nBytes = 0;
+}
+
+
+
+// multi_queue_snapshot<ELEMENT_T>::make_header()
+template <class ELEMENT_T>
+typename multi_queue_snapshot<ELEMENT_T>::header multi_queue_snapshot<ELEMENT_T>::make_header(size_type levels, size_type elements) noexcept {
+	static_assert(std::is_trivially_copyable<ELEMENT_T>::value, "snapshots store elements as raw bytes");
+	return header{ format_signature, format_version, byte_order_mark, sizeof(ELEMENT_T), alignof(ELEMENT_T), levels, elements };
+}
+
+
+
+// multi_queue_snapshot<ELEMENT_T>::validate()
+// Every level must lie inside the file, past the table, so a damaged or foreign file is rejected here rather
+// than read out of bounds later.
+template <class ELEMENT_T>
+void multi_queue_snapshot<ELEMENT_T>::validate() const {
+	if (nBytes < sizeof(header) || file_header().signature != format_signature)
+		throw std::runtime_error("multi_queue_snapshot: not a multi-queue snapshot");
+
+	header const& h = file_header();
+	if (h.version != format_version)
+		throw std::runtime_error("multi_queue_snapshot: unsupported format version");
+	if (h.byte_order != byte_order_mark || h.element_size != sizeof(ELEMENT_T) || h.element_align != alignof(ELEMENT_T))
+		throw std::runtime_error("multi_queue_snapshot: written for another element type or host");
+	if (reinterpret_cast<std::uintptr_t>(bytes) % alignof(ELEMENT_T) != 0)
+		throw std::runtime_error("multi_queue_snapshot: contents are misaligned");
+	if (h.levels > (nBytes - sizeof(header)) / sizeof(level_entry))
+		throw std::runtime_error("multi_queue_snapshot: truncated level table");
+
+	std::uint64_t const first = data_offset(static_cast<size_type>(h.levels));
+	std::uint64_t total = 0;
+	for (size_type p = 0; p < h.levels; ++p) {
+		level_entry const& level = table()[p];
+		if (level.offset < first || level.offset > nBytes || level.offset % alignof(ELEMENT_T) != 0
+			|| level.count > (nBytes - level.offset) / sizeof(ELEMENT_T))
+			throw std::runtime_error("multi_queue_snapshot: level outside the file");
+		total += level.count;
+	}
+	if (total != h.elements)
+		throw std::runtime_error("multi_queue_snapshot: element count does not match the levels");
+}
+
+
+
+// multi_queue_snapshot<ELEMENT_T>::release()
+template <class ELEMENT_T>
+void multi_queue_snapshot<ELEMENT_T>::release() noexcept {
+#if defined(__unix__) || defined(__APPLE__)
+	if (bytes && !contents)
+		::munmap(const_cast<unsigned char*>(bytes), nBytes);
+#endif
+	contents.reset();
+	bytes = nullptr;
+	nBytes = 0;
 }
@@ -6,10 +6,23 @@
 */
 #define BOOST_TEST_MODULE MultiQueueUnitTests
 #include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <list>
 #include <map>
+#include <numeric>
+#include <memory_resource>
+#include <queue>
+#include <algorithm>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <tuple>
 using namespace std;
 
 #include <boost/mpl/list.hpp>
@@ -20,7 +33,7 @@ using namespace std;
 using value_type_test_types = boost::mpl::list<int, long, unsigned char, double, string>;
 BOOST_AUTO_TEST_CASE_TEMPLATE(value_type_test, T, value_type_test_types)
 {
-	BOOST_CHECK_EQUAL(typeid(fixed_priority_multi_queue<T>::value_type).name(), typeid(T).name());
+	BOOST_CHECK_EQUAL(typeid(typename fixed_priority_multi_queue<T>::value_type).name(), typeid(T).name());
 }
 
 //=========================================
@@ -488,7 +501,7 @@ BOOST_AUTO_TEST_CASE(copy_assignment_override_larger)
 			largerQueue.push(j, i);
 	smallerQueue = largerQueue;
 	BOOST_CHECK_EQUAL(smallerQueue.size(), 2000);
-	BOOST_CHECK(smallerQueue.size(), largerQueue.size());
+	BOOST_CHECK_EQUAL(smallerQueue.size(), largerQueue.size());
 	BOOST_CHECK_EQUAL(smallerQueue.max_priority(), largerQueue.max_priority());
 }
 
@@ -590,6 +603,2107 @@ BOOST_AUTO_TEST_CASE(swap_size_test)
 	}
 }
 
+//=============================================
+//OCCUPANCY TESTS
+//=============================================
+
+/*Brief- pushes onto sparse levels spread over several bitmap words and checks that top/pop visit them in priority order*/
+BOOST_AUTO_TEST_CASE(sparse_levels_pop_in_order)
+{
+	fixed_priority_multi_queue<int> queue;
+	vector<int> priorities = { 9000, 63, 64, 4095, 4096, 0, 130 };
+	for (auto p : priorities)
+		queue.push(p, p);
+	sort(priorities.begin(), priorities.end());
+	for (auto p : priorities)
+	{
+		BOOST_CHECK_EQUAL(queue.top(), p);
+		queue.pop();
+	}
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- drains and refills a level to check that its occupancy is cleared and set again*/
+BOOST_AUTO_TEST_CASE(drained_level_is_skipped)
+{
+	fixed_priority_multi_queue<int> queue;
+	queue.push(1, 1);
+	queue.push(2, 200);
+	queue.pop();
+	BOOST_CHECK_EQUAL(queue.top(), 2);
+	queue.push(3, 1);
+	BOOST_CHECK_EQUAL(queue.top(), 3);
+	queue.pop();
+	BOOST_CHECK_EQUAL(queue.top(), 2);
+}
+
+//=============================================
+//ELEMENT COUNT TESTS
+//=============================================
+
+/*Brief- checks that size tracks every push and pop, including pushes that grow the number of levels*/
+BOOST_AUTO_TEST_CASE(count_tracks_push_and_pop)
+{
+	fixed_priority_multi_queue<string> queue;
+	string moved = "moved";
+	queue.push("copied", 5);
+	queue.push(std::move(moved), 0);
+	BOOST_CHECK_EQUAL(queue.size(), 2);
+	queue.pop();
+	BOOST_CHECK_EQUAL(queue.size(), 1);
+	queue.pop();
+	BOOST_CHECK_EQUAL(queue.size(), 0);
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks that the counts follow the elements through copy and move construction and assignment*/
+BOOST_AUTO_TEST_CASE(count_follows_copy_and_move)
+{
+	fixed_priority_multi_queue<int> queue;
+	for (auto i = 0; i < 30; ++i)
+		queue.push(i, i % 3);
+
+	fixed_priority_multi_queue<int> copied(queue);
+	fixed_priority_multi_queue<int> assigned;
+	assigned.push(1, 0);
+	assigned = copied;
+	BOOST_CHECK_EQUAL(copied.size(), 30);
+	BOOST_CHECK_EQUAL(assigned.size(), 30);
+
+	fixed_priority_multi_queue<int> moved(std::move(copied));
+	BOOST_CHECK_EQUAL(moved.size(), 30);
+	BOOST_CHECK(copied.empty());
+
+	fixed_priority_multi_queue<int> moveAssigned;
+	moveAssigned = std::move(assigned);
+	BOOST_CHECK_EQUAL(moveAssigned.size(), 30);
+	BOOST_CHECK(assigned.empty());
+
+	copied.push(7, 2);
+	BOOST_CHECK_EQUAL(copied.size(), 1);
+	BOOST_CHECK_EQUAL(copied.top(), 7);
+}
+
+/*Brief- checks that swap exchanges the element counts along with the elements*/
+BOOST_AUTO_TEST_CASE(count_follows_swap)
+{
+	fixed_priority_multi_queue<int> oneQueue;
+	fixed_priority_multi_queue<int> twoQueue;
+	for (auto i = 0; i < 5; ++i)
+		oneQueue.push(i, 1);
+	twoQueue.push(9, 0);
+	swap(oneQueue, twoQueue);
+	BOOST_CHECK_EQUAL(oneQueue.size(), 1);
+	BOOST_CHECK_EQUAL(twoQueue.size(), 5);
+	oneQueue.pop();
+	BOOST_CHECK(oneQueue.empty());
+	BOOST_CHECK_EQUAL(twoQueue.size(), 5);
+}
+
+/*Brief- checks that the iterator constructor counts every pair it loads*/
+BOOST_AUTO_TEST_CASE(count_after_iterator_constructor)
+{
+	vector<pair<int, int>> loadVector;
+	for (auto i = 0; i < 100; ++i)
+		loadVector.push_back(make_pair(i, i % 7));
+	fixed_priority_multi_queue<int> queue(loadVector.begin(), loadVector.end());
+	BOOST_CHECK_EQUAL(queue.size(), loadVector.size());
+	for (auto i = 0; i < 100; ++i)
+		queue.pop();
+	BOOST_CHECK(queue.empty());
+}
+
+//=============================================
+//CONCURRENT QUEUE TESTS
+//=============================================
+
+/*Brief- checks that try_pop returns elements in priority order and fails once the queue is empty*/
+BOOST_AUTO_TEST_CASE(concurrent_try_pop_order)
+{
+	concurrent_fixed_priority_multi_queue<int> queue(200);
+	queue.push(3, 130);
+	queue.push(1, 2);
+	queue.push(2, 2);
+	BOOST_CHECK_EQUAL(queue.size(), 3);
+	int value = 0;
+	for (auto expected : { 1, 2, 3 })
+	{
+		BOOST_CHECK(queue.try_pop(value));
+		BOOST_CHECK_EQUAL(value, expected);
+	}
+	BOOST_CHECK(!queue.try_pop(value));
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks that pushing beyond the fixed number of levels throws*/
+BOOST_AUTO_TEST_CASE(concurrent_push_out_of_range)
+{
+	concurrent_fixed_priority_multi_queue<int> queue(4);
+	BOOST_CHECK_THROW(queue.push(1, 4), std::out_of_range);
+}
+
+/*Brief- checks that wait_pop times out on an empty queue and that close releases a blocked consumer*/
+BOOST_AUTO_TEST_CASE(concurrent_wait_pop_timeout_and_close)
+{
+	concurrent_fixed_priority_multi_queue<int> queue(4);
+	int value = 0;
+	BOOST_CHECK(!queue.wait_pop(value, chrono::milliseconds(10)));
+
+	thread consumer([&] { BOOST_CHECK(!queue.wait_pop(value)); });
+	this_thread::sleep_for(chrono::milliseconds(10));
+	queue.close();
+	consumer.join();
+	BOOST_CHECK(queue.is_closed());
+	BOOST_CHECK(!queue.push(1, 0));
+}
+
+/*Brief- runs producers on separate levels against blocking consumers and checks every element arrives exactly once*/
+BOOST_AUTO_TEST_CASE(concurrent_producers_and_consumers)
+{
+	const int nProducers = 4, nPerProducer = 5000;
+	concurrent_fixed_priority_multi_queue<int> queue(nProducers);
+	atomic<long long> total(0);
+	atomic<int> received(0);
+
+	vector<thread> consumers;
+	for (auto c = 0; c < 2; ++c)
+		consumers.emplace_back([&] {
+			int value;
+			while (queue.wait_pop(value))
+			{
+				total += value;
+				++received;
+			}
+		});
+
+	vector<thread> producers;
+	for (auto p = 0; p < nProducers; ++p)
+		producers.emplace_back([&, p] {
+			for (auto i = 1; i <= nPerProducer; ++i)
+				queue.push(i, p);
+		});
+	for (auto& t : producers)
+		t.join();
+	while (!queue.empty())
+		this_thread::yield();
+	queue.close();
+	for (auto& t : consumers)
+		t.join();
+
+	BOOST_CHECK_EQUAL(received.load(), nProducers * nPerProducer);
+	BOOST_CHECK_EQUAL(total.load(), (long long)nProducers * nPerProducer * (nPerProducer + 1) / 2);
+}
+
+/*Brief- checks that the padded layout keeps every level on its own cache line and preserves priority order under concurrent producers*/
+BOOST_AUTO_TEST_CASE(concurrent_padded_levels)
+{
+	static_assert(alignof(padded_levels::slot<pair<mutex, ring_buffer<int>>>) == cache_line_size, "padded levels are line aligned");
+	const int nProducers = 4, nPerProducer = 2000;
+	padded_concurrent_fixed_priority_multi_queue<int> queue(nProducers);
+
+	vector<thread> producers;
+	for (auto p = 0; p < nProducers; ++p)
+		producers.emplace_back([&, p] {
+			for (auto i = 0; i < nPerProducer; ++i)
+				queue.push(p, p);
+		});
+	for (auto& t : producers)
+		t.join();
+	BOOST_CHECK_EQUAL(queue.size(), nProducers * nPerProducer);
+
+	int value = 0, previous = 0;
+	for (auto i = 0; i < nProducers * nPerProducer; ++i)
+	{
+		BOOST_REQUIRE(queue.try_pop(value));
+		BOOST_CHECK_LE(previous, value);
+		previous = value;
+	}
+	BOOST_CHECK(!queue.try_pop(value));
+}
+
+using wait_strategies = boost::mpl::list<condition_wait, busy_spin_wait, spin_yield_wait<>, futex_wait<>>;
+
+/*Brief- runs blocking consumers under every wait strategy, checking timeouts, delivery of every element and release on close*/
+BOOST_AUTO_TEST_CASE_TEMPLATE(concurrent_wait_strategies, WAIT, wait_strategies)
+{
+	const int nPerProducer = 2000;
+	concurrent_fixed_priority_multi_queue<int, ring_buffer<int>, packed_levels, WAIT> queue(4);
+	int value = 0;
+	BOOST_CHECK(!queue.wait_pop(value, chrono::milliseconds(5)));
+
+	atomic<long long> total(0);
+	vector<thread> consumers;
+	for (auto c = 0; c < 2; ++c)
+		consumers.emplace_back([&] {
+			int v;
+			while (queue.wait_pop(v))
+				total += v;
+		});
+
+	thread producer([&] {
+		for (auto i = 1; i <= nPerProducer; ++i)
+		{
+			queue.push(i, i % 4);
+			if (i % 500 == 0)
+				this_thread::sleep_for(chrono::milliseconds(1));
+		}
+	});
+	producer.join();
+	while (!queue.empty())
+		this_thread::yield();
+	queue.close();
+	for (auto& t : consumers)
+		t.join();
+	BOOST_CHECK_EQUAL(total.load(), (long long)nPerProducer * (nPerProducer + 1) / 2);
+}
+
+using blocking_wait_strategies = boost::mpl::list<condition_wait, futex_wait<>>;
+
+/*Brief- keeps emptying one level while another level of the same bitmap word is filled, checking that no push is missed by a sleeping waiter*/
+BOOST_AUTO_TEST_CASE_TEMPLATE(concurrent_wait_pop_during_reset, WAIT, blocking_wait_strategies)
+{
+	const int nRounds = 2000;
+	concurrent_fixed_priority_multi_queue<int, ring_buffer<int>, packed_levels, WAIT> queue(2);
+	atomic<bool> done(false);
+	thread toggler([&] {
+		int v;
+		while (!done.load())
+		{
+			queue.push(0, 0);
+			queue.try_pop_within(v, 0);
+		}
+	});
+
+	int received = 0;
+	thread consumer([&] {
+		int v;
+		while (received < nRounds && queue.wait_pop(v, chrono::seconds(5)))
+			if (v != 0)
+				++received;
+	});
+	for (auto i = 1; i <= nRounds; ++i)
+	{
+		queue.push(i, 1);
+		while (queue.size() > 1)
+			this_thread::yield();
+	}
+	consumer.join();
+	done.store(true);
+	toggler.join();
+	BOOST_CHECK_EQUAL(received, nRounds);
+}
+
+/*Brief- checks that the _within pops leave worse priorities queued and that a limited waiter wakes for an urgent element*/
+BOOST_AUTO_TEST_CASE_TEMPLATE(concurrent_wait_pop_within, WAIT, wait_strategies)
+{
+	concurrent_fixed_priority_multi_queue<int, ring_buffer<int>, packed_levels, WAIT> queue(8);
+	queue.push(5, 5);
+	int value = 0;
+	BOOST_CHECK(!queue.try_pop_within(value, 4));
+	BOOST_CHECK(!queue.wait_pop_within(value, 4, chrono::milliseconds(5)));
+	BOOST_CHECK(queue.try_pop_within(value, 5));
+	BOOST_CHECK_EQUAL(value, 5);
+
+	// a general waiter and an urgent waiter; a backlog push must not strand the urgent one
+	int urgent = -1, general = -1;
+	bool urgentPopped = false, generalPopped = false;
+	thread urgentConsumer([&] { urgentPopped = queue.wait_pop_within(urgent, 1); });
+	thread generalConsumer([&] { generalPopped = queue.wait_pop(general); });
+	this_thread::sleep_for(chrono::milliseconds(5));
+	queue.push(7, 7);
+	while (!queue.empty())
+		this_thread::yield();
+	queue.push(1, 1);
+	urgentConsumer.join();
+	generalConsumer.join();
+	BOOST_CHECK(urgentPopped && generalPopped);
+	BOOST_CHECK_EQUAL(urgent, 1);
+	BOOST_CHECK_EQUAL(general, 7);
+	BOOST_CHECK(queue.empty());
+
+	thread closedConsumer([&] { BOOST_CHECK(!queue.wait_pop_within(value, 0)); });
+	queue.push(3, 3);
+	this_thread::sleep_for(chrono::milliseconds(5));
+	queue.close();
+	closedConsumer.join();
+	BOOST_CHECK_EQUAL(queue.size(), 1);
+}
+
+//=============================================
+//LOCK-FREE QUEUE TESTS
+//=============================================
+
+/*Brief- checks that try_push reports a full level and try_pop returns elements in priority order*/
+BOOST_AUTO_TEST_CASE(lock_free_full_level_and_order)
+{
+	lock_free_fixed_priority_multi_queue<string> queue(100, 3);
+	BOOST_CHECK_EQUAL(queue.capacity(), 4);
+	for (auto i = 0; i < 4; ++i)
+		BOOST_CHECK(queue.try_push(to_string(i), 70));
+	BOOST_CHECK(!queue.try_push("full", 70));
+	BOOST_CHECK(queue.try_push("first", 5));
+	BOOST_CHECK_EQUAL(queue.size(), 5);
+
+	string value;
+	BOOST_CHECK(queue.try_pop(value));
+	BOOST_CHECK_EQUAL(value, "first");
+	for (auto i = 0; i < 4; ++i)
+	{
+		BOOST_CHECK(queue.try_pop(value));
+		BOOST_CHECK_EQUAL(value, to_string(i));
+	}
+	BOOST_CHECK(!queue.try_pop(value));
+	BOOST_CHECK(queue.empty());
+}
+
+namespace
+{
+	// copies throw when the value is negative; moves never throw, as the lock-free ring requires
+	struct brittle
+	{
+		int value;
+		brittle(int value = 0) : value(value) {}
+		brittle(brittle const& other) : value(other.value)
+		{
+			if (value < 0)
+				throw runtime_error("brittle copy");
+		}
+		brittle(brittle&&) noexcept = default;
+		brittle& operator = (brittle const&) = default;
+		brittle& operator = (brittle&&) noexcept = default;
+	};
+}
+
+/*Brief- checks that a throwing copy leaves the level and the count as they were, so later pushes and pops go on*/
+BOOST_AUTO_TEST_CASE(lock_free_throwing_copy)
+{
+	lock_free_fixed_priority_multi_queue<brittle> queue(4, 4);
+	brittle const bad(-1);
+	BOOST_CHECK(queue.try_push(brittle(1), 2));
+	BOOST_CHECK_THROW(queue.try_push(bad, 2), runtime_error);
+	BOOST_CHECK_EQUAL(queue.size(), 1);
+
+	// the failed copy claimed no cell: the level still takes its full capacity and hands it back in order
+	for (auto i = 2; i <= 4; ++i)
+		BOOST_CHECK(queue.try_push(brittle(i), 2));
+	BOOST_CHECK(!queue.try_push(brittle(5), 2));
+	BOOST_CHECK_EQUAL(queue.size(), 4);
+	brittle value;
+	for (auto expected = 1; expected <= 4; ++expected)
+	{
+		BOOST_REQUIRE(queue.try_pop(value));
+		BOOST_CHECK_EQUAL(value.value, expected);
+	}
+	BOOST_CHECK(!queue.try_pop(value));
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- runs producers and consumers concurrently and checks every element arrives exactly once*/
+BOOST_AUTO_TEST_CASE(lock_free_producers_and_consumers)
+{
+	const int nProducers = 4, nPerProducer = 20000;
+	lock_free_fixed_priority_multi_queue<int> queue(nProducers, 256);
+	atomic<long long> total(0);
+	atomic<int> received(0);
+
+	vector<thread> threads;
+	for (auto p = 0; p < nProducers; ++p)
+		threads.emplace_back([&, p] {
+			for (auto i = 1; i <= nPerProducer; ++i)
+				while (!queue.try_push(i, p))
+					this_thread::yield();
+		});
+	for (auto c = 0; c < 2; ++c)
+		threads.emplace_back([&] {
+			int value;
+			while (received.load() < nProducers * nPerProducer)
+				if (queue.try_pop(value))
+				{
+					total += value;
+					++received;
+				}
+				else
+					this_thread::yield();
+		});
+	for (auto& t : threads)
+		t.join();
+
+	BOOST_CHECK_EQUAL(received.load(), nProducers * nPerProducer);
+	BOOST_CHECK_EQUAL(total.load(), (long long)nProducers * nPerProducer * (nPerProducer + 1) / 2);
+	BOOST_CHECK(queue.empty());
+}
+
+//=============================================
+//STATIC MULTI-QUEUE TESTS
+//=============================================
+
+/*Brief- checks that max_priority is usable in constant expressions*/
+BOOST_AUTO_TEST_CASE(static_max_priority_is_constexpr)
+{
+	static_assert(static_multi_queue<int, 8>::max_priority() == 8, "max_priority should be a constant expression");
+	static_multi_queue<int, 8> queue;
+	BOOST_CHECK(queue.empty());
+	BOOST_CHECK_EQUAL(queue.size(), 0);
+}
+
+/*Brief- checks priority order with a single-word mask and FIFO order within a level*/
+BOOST_AUTO_TEST_CASE(static_single_word_order)
+{
+	static_multi_queue<string, 4> queue;
+	queue.push("low", 3);
+	queue.push("high1", 0);
+	queue.push("high2", 0);
+	queue.push("mid", 2);
+	for (auto expected : { "high1", "high2", "mid", "low" })
+	{
+		BOOST_CHECK_EQUAL(queue.top(), expected);
+		queue.pop();
+	}
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks priority order across several mask words and that swap exchanges contents*/
+BOOST_AUTO_TEST_CASE(static_multi_word_order_and_swap)
+{
+	vector<pair<int, int>> loadVector = { { 300, 300 }, { 64, 64 }, { 200, 200 }, { 63, 63 } };
+	static_multi_queue<int, 301> queue(loadVector.begin(), loadVector.end());
+	static_multi_queue<int, 301> other;
+	other.push(1, 1);
+	swap(queue, other);
+	BOOST_CHECK_EQUAL(queue.size(), 1);
+	BOOST_CHECK_EQUAL(queue.top(), 1);
+	for (auto expected : { 63, 64, 200, 300 })
+	{
+		BOOST_CHECK_EQUAL(other.top(), expected);
+		other.pop();
+	}
+	BOOST_CHECK(other.empty());
+}
+
+//=============================================
+//LEVEL CONTAINER TESTS
+//=============================================
+
+/*Brief- wraps the ring buffer around its allocation before growing it and checks FIFO order survives*/
+BOOST_AUTO_TEST_CASE(ring_buffer_wraps_and_grows)
+{
+	ring_buffer<string> ring;
+	for (auto i = 0; i < 6; ++i)
+		ring.push(to_string(i));
+	for (auto i = 0; i < 4; ++i)
+		ring.pop();
+	for (auto i = 6; i < 30; ++i)
+		ring.push(to_string(i));
+	BOOST_CHECK_EQUAL(ring.size(), 26);
+	ring_buffer<string> copy(ring);
+	for (auto i = 4; i < 30; ++i)
+	{
+		BOOST_CHECK_EQUAL(ring.front(), to_string(i));
+		BOOST_CHECK_EQUAL(copy.front(), to_string(i));
+		ring.pop();
+		copy.pop();
+	}
+	BOOST_CHECK(ring.empty());
+}
+
+/*Brief- checks that a drained ring buffer keeps its allocation for the next burst*/
+BOOST_AUTO_TEST_CASE(ring_buffer_reuses_storage)
+{
+	ring_buffer<int> ring;
+	for (auto i = 0; i < 100; ++i)
+		ring.push(i);
+	auto const capacity = ring.capacity();
+	while (!ring.empty())
+		ring.pop();
+	for (auto i = 0; i < 100; ++i)
+		ring.push(i);
+	BOOST_CHECK_EQUAL(ring.capacity(), capacity);
+	BOOST_CHECK_EQUAL(ring.back(), 99);
+}
+
+/*Brief- checks that pushing an element of the buffer onto itself is safe when the push reallocates*/
+BOOST_AUTO_TEST_CASE(ring_buffer_self_push)
+{
+	ring_buffer<string> ring;
+	ring.push("self");
+	while (ring.size() < ring.capacity())
+		ring.push("fill");
+	ring.push(ring.front());
+	BOOST_CHECK_EQUAL(ring.back(), "self");
+}
+
+/*Brief- runs the same priority-order scenario with the std::queue level container*/
+using level_types = boost::mpl::list<ring_buffer<int>, std::queue<int>>;
+BOOST_AUTO_TEST_CASE_TEMPLATE(level_container_priority_order, LEVEL, level_types)
+{
+	fixed_priority_multi_queue<int, LEVEL> queue;
+	for (auto i = 0; i < 3; ++i)
+		for (auto j = 0; j < 20; ++j)
+			queue.push(i * 100 + j, 2 - i);
+	fixed_priority_multi_queue<int, LEVEL> copy(queue);
+	for (auto i = 2; i >= 0; --i)
+		for (auto j = 0; j < 20; ++j)
+		{
+			BOOST_CHECK_EQUAL(queue.top(), i * 100 + j);
+			BOOST_CHECK_EQUAL(copy.top(), i * 100 + j);
+			queue.pop();
+			copy.pop();
+		}
+	BOOST_CHECK(queue.empty());
+}
+
+//=============================================
+//ALLOCATOR TESTS
+//=============================================
+
+/*Brief- memory resource that counts the bytes it hands out*/
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+	size_t allocated = 0;
+	size_t outstanding = 0;
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		allocated += bytes;
+		outstanding += bytes;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+	void do_deallocate(void* p, size_t bytes, size_t alignment) override
+	{
+		outstanding -= bytes;
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+	bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override { return this == &other; }
+};
+
+/*Brief- checks that the level vector and every level allocate from the queue's memory resource*/
+BOOST_AUTO_TEST_CASE(pmr_levels_use_queue_resource)
+{
+	counting_resource resource;
+	{
+		pmr_fixed_priority_multi_queue<int> queue(&resource);
+		for (auto i = 0; i < 10; ++i)
+			for (auto j = 0; j < 50; ++j)
+				queue.push(j, i);
+		BOOST_CHECK(resource.allocated >= 10 * 50 * sizeof(int));
+		BOOST_CHECK(queue.get_allocator().resource() == &resource);
+		BOOST_CHECK_EQUAL(queue.top(), 0);
+	}
+	BOOST_CHECK_EQUAL(resource.outstanding, 0);
+}
+
+/*Brief- backs a queue with a monotonic buffer and checks that no allocation reaches the upstream resource*/
+BOOST_AUTO_TEST_CASE(pmr_monotonic_arena)
+{
+	counting_resource upstream;
+	std::vector<std::byte> arena(1 << 16);
+	std::pmr::monotonic_buffer_resource batch(arena.data(), arena.size(), &upstream);
+	pmr_fixed_priority_multi_queue<int> queue(&batch);
+	for (auto i = 0; i < 4; ++i)
+		for (auto j = 0; j < 100; ++j)
+			queue.push(j, i);
+	while (!queue.empty())
+		queue.pop();
+	BOOST_CHECK_EQUAL(upstream.allocated, 0);
+}
+
+/*Brief- checks the allocator-extended copy and move constructors*/
+BOOST_AUTO_TEST_CASE(pmr_allocator_extended_constructors)
+{
+	counting_resource first, second;
+	pmr_fixed_priority_multi_queue<string> queue(&first);
+	queue.push("b", 1);
+	queue.push("a", 0);
+
+	pmr_fixed_priority_multi_queue<string> copy(queue, &second);
+	BOOST_CHECK(copy.get_allocator().resource() == &second);
+	BOOST_CHECK_EQUAL(copy.size(), 2);
+	BOOST_CHECK_EQUAL(copy.top(), "a");
+
+	pmr_fixed_priority_multi_queue<string> moved(std::move(queue), &second);
+	BOOST_CHECK(moved.get_allocator().resource() == &second);
+	BOOST_CHECK_EQUAL(moved.size(), 2);
+	BOOST_CHECK(queue.empty());
+	moved.pop();
+	BOOST_CHECK_EQUAL(moved.top(), "b");
+}
+
+//=============================================
+//NODE POOL TESTS
+//=============================================
+
+/*Brief- pushes across several chunks and checks FIFO order and copies with the chunked level container*/
+BOOST_AUTO_TEST_CASE(chunked_queue_fifo_and_copy)
+{
+	chunked_queue<string, std::allocator<string>, 4> chunks;
+	for (auto i = 0; i < 10; ++i)
+		chunks.push(to_string(i));
+	chunks.pop();
+	chunked_queue<string, std::allocator<string>, 4> copy(chunks);
+	for (auto i = 1; i < 10; ++i)
+	{
+		BOOST_CHECK_EQUAL(chunks.front(), to_string(i));
+		BOOST_CHECK_EQUAL(copy.front(), to_string(i));
+		chunks.pop();
+		copy.pop();
+	}
+	BOOST_CHECK(chunks.empty());
+	BOOST_CHECK(copy.empty());
+}
+
+/*Brief- checks that after reserve a pooled queue cycles through fill and drain without new chunks*/
+BOOST_AUTO_TEST_CASE(pooled_queue_no_allocation_after_warm_up)
+{
+	pooled_fixed_priority_multi_queue<int, 16> queue;
+	queue.push(0, 7);
+	queue.pop();
+	queue.reserve(1000);
+	auto& pool = queue.get_allocator().resource();
+	auto const allocated = pool.allocated_chunks();
+	for (auto round = 0; round < 5; ++round)
+	{
+		for (auto i = 0; i < 1000; ++i)
+			queue.push(i, i % 8);
+		BOOST_CHECK_EQUAL(queue.size(), 1000);
+		for (auto p = 0; p < 8; ++p)
+			for (auto i = p; i < 1000; i += 8)
+			{
+				BOOST_CHECK_EQUAL(queue.top(), i);
+				queue.pop();
+			}
+	}
+	BOOST_CHECK_EQUAL(pool.allocated_chunks(), allocated);
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks that levels share the pool and that a copied queue gets a pool of its own*/
+BOOST_AUTO_TEST_CASE(pooled_queue_pool_ownership)
+{
+	pooled_fixed_priority_multi_queue<string> queue;
+	queue.push("a", 0);
+	queue.push("b", 3);
+	pooled_fixed_priority_multi_queue<string> copy(queue);
+	BOOST_CHECK(&copy.get_allocator().resource() != &queue.get_allocator().resource());
+	BOOST_CHECK_EQUAL(copy.size(), 2);
+	BOOST_CHECK_EQUAL(copy.top(), "a");
+
+	pooled_fixed_priority_multi_queue<string> moved(std::move(queue));
+	BOOST_CHECK_EQUAL(moved.top(), "a");
+	moved.pop();
+	BOOST_CHECK_EQUAL(moved.top(), "b");
+}
+
+//=============================================
+//BULK OPERATION TESTS
+//=============================================
+
+/*Brief- appends a range to one level and checks it lands behind the elements already there*/
+BOOST_AUTO_TEST_CASE(push_range_single_level)
+{
+	fixed_priority_multi_queue<int> queue;
+	queue.push(-1, 3);
+	vector<int> batch = { 1, 2, 3, 4 };
+	queue.push_range(batch.begin(), batch.end(), 3);
+	queue.push_range(batch.begin(), batch.begin(), 9);
+	BOOST_CHECK_EQUAL(queue.size(), 5);
+	BOOST_CHECK_EQUAL(queue.max_priority(), 4);
+	for (auto expected : { -1, 1, 2, 3, 4 })
+	{
+		BOOST_CHECK_EQUAL(queue.top(), expected);
+		queue.pop();
+	}
+}
+
+namespace
+{
+	// copies throw when the value is negative
+	struct fragile
+	{
+		int value;
+		fragile(int value) : value(value) {}
+		fragile(fragile const& other) : value(other.value)
+		{
+			if (value < 0)
+				throw runtime_error("fragile copy");
+		}
+	};
+}
+
+/*Brief- checks that elements pushed before a throwing copy in a range stay reachable*/
+BOOST_AUTO_TEST_CASE(push_range_throwing_copy)
+{
+	vector<fragile> batch;
+	for (auto v : { 1, 2, -3, 4 })
+		batch.emplace_back(v);
+	fixed_priority_multi_queue<fragile> queue;
+	BOOST_CHECK_THROW(queue.push_range(batch.begin(), batch.end(), 2), runtime_error);
+	BOOST_REQUIRE_EQUAL(queue.size(), 2);
+	BOOST_CHECK_EQUAL(queue.top_priority(), 2);
+	for (auto expected : { 1, 2 })
+	{
+		BOOST_CHECK_EQUAL(queue.top().value, expected);
+		queue.pop();
+	}
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- loads a range of value/priority pairs and checks priority and FIFO order*/
+BOOST_AUTO_TEST_CASE(push_range_pairs)
+{
+	vector<pair<string, int>> batch = { { "c1", 2 }, { "a1", 0 }, { "c2", 2 }, { "b1", 1 }, { "a2", 0 } };
+	fixed_priority_multi_queue<string> queue;
+	queue.push_range(batch.begin(), batch.end());
+	BOOST_CHECK_EQUAL(queue.size(), 5);
+	for (auto expected : { "a1", "a2", "b1", "c1", "c2" })
+	{
+		BOOST_CHECK_EQUAL(queue.top(), expected);
+		queue.pop();
+	}
+}
+
+/*Brief- drains a batch across several levels with pop_n, then the remainder with an oversized request*/
+BOOST_AUTO_TEST_CASE(pop_n_in_priority_order)
+{
+	fixed_priority_multi_queue<int> queue;
+	for (auto i = 0; i < 30; ++i)
+		queue.push(i, i / 10);
+	vector<int> out;
+	queue.pop_n(back_inserter(out), 15);
+	BOOST_CHECK_EQUAL(out.size(), 15);
+	BOOST_CHECK_EQUAL(queue.size(), 15);
+	BOOST_CHECK_EQUAL(queue.top(), 15);
+	queue.pop_n(back_inserter(out), 100);
+	BOOST_CHECK(queue.empty());
+	for (auto i = 0; i < 30; ++i)
+		BOOST_CHECK_EQUAL(out[i], i);
+	queue.push(1, 0);
+	BOOST_CHECK_EQUAL(queue.top(), 1);
+}
+
+//=============================================
+//TRY_POP TESTS
+//=============================================
+
+/*Brief- checks that the optional try_pop moves elements out in priority order and is empty once drained*/
+BOOST_AUTO_TEST_CASE(try_pop_optional)
+{
+	fixed_priority_multi_queue<string> queue;
+	queue.push("second", 4);
+	queue.push("first", 1);
+	auto value = queue.try_pop();
+	BOOST_REQUIRE(value.has_value());
+	BOOST_CHECK_EQUAL(*value, "first");
+	BOOST_CHECK_EQUAL(queue.size(), 1);
+	value = queue.try_pop();
+	BOOST_REQUIRE(value.has_value());
+	BOOST_CHECK_EQUAL(*value, "second");
+	BOOST_CHECK(!queue.try_pop().has_value());
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks the out-parameter try_pop and that it leaves the target untouched on an empty queue*/
+BOOST_AUTO_TEST_CASE(try_pop_out_parameter)
+{
+	fixed_priority_multi_queue<int> queue;
+	int value = -1;
+	BOOST_CHECK(!queue.try_pop(value));
+	BOOST_CHECK_EQUAL(value, -1);
+	queue.push(5, 2);
+	queue.push(6, 2);
+	BOOST_CHECK(queue.try_pop(value));
+	BOOST_CHECK_EQUAL(value, 5);
+	BOOST_CHECK(queue.try_pop(value));
+	BOOST_CHECK_EQUAL(value, 6);
+	BOOST_CHECK(!queue.try_pop(value));
+}
+
+/*Brief- checks that pop on an empty queue leaves it empty and usable*/
+BOOST_AUTO_TEST_CASE(pop_on_empty_queue)
+{
+	fixed_priority_multi_queue<int> queue;
+	queue.pop();
+	BOOST_CHECK(queue.empty());
+	queue.push(1, 3);
+	queue.pop();
+	queue.pop();
+	BOOST_CHECK(queue.empty());
+	queue.push(2, 0);
+	BOOST_CHECK_EQUAL(queue.top(), 2);
+}
+
+//=============================================
+//EMPLACE TESTS
+//=============================================
+
+/*Brief- element type that counts how it was constructed*/
+struct counted
+{
+	static int constructions, copies, moves;
+	string name;
+	vector<int> data;
+	counted(string name, int n) : name(std::move(name)), data(n, n) { ++constructions; }
+	counted(counted const& other) : name(other.name), data(other.data) { ++copies; }
+	counted(counted&& other) noexcept : name(std::move(other.name)), data(std::move(other.data)) { ++moves; }
+	counted& operator = (counted const& other) { name = other.name; data = other.data; ++copies; return *this; }
+	counted& operator = (counted&& other) noexcept { name = std::move(other.name); data = std::move(other.data); ++moves; return *this; }
+	static void reset() { constructions = copies = moves = 0; }
+};
+int counted::constructions = 0;
+int counted::copies = 0;
+int counted::moves = 0;
+
+/*Brief- checks that emplace constructs the element in its level without any copy or move*/
+BOOST_AUTO_TEST_CASE(emplace_constructs_in_place)
+{
+	fixed_priority_multi_queue<counted> queue;
+	counted::reset();
+	auto& element = queue.emplace(3, "task", 4);
+	BOOST_CHECK_EQUAL(counted::constructions, 1);
+	BOOST_CHECK_EQUAL(counted::copies, 0);
+	BOOST_CHECK_EQUAL(counted::moves, 0);
+	BOOST_CHECK_EQUAL(element.name, "task");
+	BOOST_CHECK_EQUAL(queue.size(), 1);
+	BOOST_CHECK_EQUAL(queue.top().data.size(), 4);
+}
+
+/*Brief- checks that emplace keeps FIFO order with push and works with the std::queue and static containers*/
+BOOST_AUTO_TEST_CASE(emplace_order)
+{
+	fixed_priority_multi_queue<string, std::queue<string>> queue;
+	queue.push("a", 1);
+	queue.emplace(1, 3, 'b');
+	queue.emplace(0, "c");
+	BOOST_CHECK_EQUAL(queue.top(), "c");
+	queue.pop();
+	BOOST_CHECK_EQUAL(queue.top(), "a");
+	queue.pop();
+	BOOST_CHECK_EQUAL(queue.top(), "bbb");
+
+	static_multi_queue<string, 2> fixed;
+	BOOST_CHECK_EQUAL(fixed.emplace(1, 2, 'x'), "xx");
+	BOOST_CHECK_EQUAL(fixed.top(), "xx");
+}
+
+/*Brief- checks that the iterator constructor copies each value once and moves instead through a move_iterator*/
+BOOST_AUTO_TEST_CASE(iterator_constructor_construction_counts)
+{
+	vector<pair<counted, int>> batch;
+	for (auto i = 0; i < 20; ++i)
+		batch.emplace_back(piecewise_construct, forward_as_tuple("job", i), forward_as_tuple(i % 3));
+
+	counted::reset();
+	fixed_priority_multi_queue<counted> copied(batch.begin(), batch.end());
+	BOOST_CHECK_EQUAL(counted::copies, 20);
+	BOOST_CHECK_EQUAL(counted::moves, 0);
+
+	counted::reset();
+	fixed_priority_multi_queue<counted> moved(make_move_iterator(batch.begin()), make_move_iterator(batch.end()));
+	BOOST_CHECK_EQUAL(counted::copies, 0);
+	BOOST_CHECK_EQUAL(counted::moves, 20);
+	BOOST_CHECK_EQUAL(counted::constructions, 0);
+	BOOST_CHECK_EQUAL(moved.size(), 20);
+	BOOST_CHECK_EQUAL(moved.top().data.size(), 0);
+}
+
+//=============================================
+//STATISTICS TESTS
+//=============================================
+
+/*Brief- checks that the default policy adds nothing to the queue and reports an empty snapshot*/
+BOOST_AUTO_TEST_CASE(stats_disabled_is_free)
+{
+	BOOST_CHECK_EQUAL(sizeof(fixed_priority_multi_queue<int>), sizeof(fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<>>) - sizeof(level_stats<>));
+	fixed_priority_multi_queue<int> queue;
+	queue.push(1, 2);
+	auto const stats = queue.stats();
+	BOOST_CHECK(stats.levels.empty());
+	BOOST_CHECK(stats.sojourn.empty());
+}
+
+/*Brief- checks the per-level push and pop counts and the depth high-water marks*/
+BOOST_AUTO_TEST_CASE(stats_level_counters)
+{
+	fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<>> queue;
+	for (int i = 0; i < 5; ++i)
+		queue.push(i, 2);
+	queue.emplace(0, 9);
+	vector<pair<int, size_t>> const pairs{ { 1, 2 }, { 2, 1 } };
+	queue.push_range(pairs.begin(), pairs.end());
+	queue.pop();
+	queue.pop();
+	queue.try_pop();
+	vector<int> drained;
+	queue.pop_n(back_inserter(drained), 2);
+
+	auto const stats = queue.stats();
+	BOOST_REQUIRE_EQUAL(stats.levels.size(), 3);
+	BOOST_CHECK(stats.sojourn.empty());
+	BOOST_CHECK_EQUAL(stats.levels[0].pushes, 1);
+	BOOST_CHECK_EQUAL(stats.levels[0].pops, 1);
+	BOOST_CHECK_EQUAL(stats.levels[1].pushes, 1);
+	BOOST_CHECK_EQUAL(stats.levels[1].pops, 1);
+	BOOST_CHECK_EQUAL(stats.levels[2].pushes, 6);
+	BOOST_CHECK_EQUAL(stats.levels[2].pops, 3);
+	BOOST_CHECK_EQUAL(stats.levels[2].max_depth, 6);
+	BOOST_CHECK_EQUAL(queue.size(), 3);
+}
+
+/*Brief- checks that timestamps fill one sojourn histogram per level with one entry per pop*/
+BOOST_AUTO_TEST_CASE(stats_sojourn_histogram)
+{
+	fixed_priority_multi_queue<string, ring_buffer<string>, level_stats<true>> queue;
+	for (int i = 0; i < 20; ++i)
+		queue.push(to_string(i), i % 4);
+	queue.push("slow", 5);
+	this_thread::sleep_for(chrono::milliseconds(2));
+	while (!queue.empty())
+		queue.pop();
+
+	auto const stats = queue.stats();
+	BOOST_REQUIRE_EQUAL(stats.sojourn.size(), 6);
+	for (size_t p = 0; p < stats.sojourn.size(); ++p) {
+		auto const& histogram = stats.sojourn[p];
+		BOOST_CHECK_EQUAL(accumulate(histogram.begin(), histogram.end(), uint64_t(0)), stats.levels[p].pops);
+	}
+	// 2ms is above 2^20 ns
+	auto const& slow = stats.sojourn[5];
+	BOOST_CHECK_EQUAL(accumulate(slow.begin() + 20, slow.end(), uint64_t(0)), 1);
+}
+
+/*Brief- checks that statistics travel with copies, moves and swaps*/
+BOOST_AUTO_TEST_CASE(stats_copy_move_swap)
+{
+	using queue_t = fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<true>>;
+	queue_t queue;
+	queue.push(1, 0);
+	queue.push(2, 1);
+
+	queue_t copy(queue);
+	BOOST_CHECK_EQUAL(copy.stats().levels[1].pushes, 1);
+	copy.pop();
+	copy.pop();
+	BOOST_CHECK_EQUAL(copy.stats().levels[1].pops, 1);
+
+	queue_t moved(std::move(queue));
+	BOOST_CHECK(queue.stats().levels.empty());
+	queue.push(3, 4);
+	BOOST_CHECK_EQUAL(queue.stats().levels.size(), 5);
+
+	swap(queue, moved);
+	BOOST_CHECK_EQUAL(queue.stats().levels.size(), 2);
+	BOOST_CHECK_EQUAL(moved.stats().levels[4].pushes, 1);
+	while (!queue.empty())
+		queue.pop();
+	BOOST_CHECK_EQUAL(queue.stats().levels[0].pops, 1);
+}
+
+//=============================================
+//SCHEDULING TESTS
+//=============================================
+
+/*Brief- checks find_next on the hierarchical bitmap across word and layer boundaries*/
+BOOST_AUTO_TEST_CASE(occupancy_find_next)
+{
+	occupancy_bitmap bits;
+	bits.resize(64 * 64 * 2);
+	BOOST_CHECK_EQUAL(bits.find_next(0), occupancy_bitmap::npos);
+	for (size_t bit : { 3, 64, 4095, 4096, 8000 })
+		bits.set(bit);
+	BOOST_CHECK_EQUAL(bits.find_next(0), 3);
+	BOOST_CHECK_EQUAL(bits.find_next(3), 3);
+	BOOST_CHECK_EQUAL(bits.find_next(4), 64);
+	BOOST_CHECK_EQUAL(bits.find_next(65), 4095);
+	BOOST_CHECK_EQUAL(bits.find_next(4096), 4096);
+	BOOST_CHECK_EQUAL(bits.find_next(4097), 8000);
+	BOOST_CHECK_EQUAL(bits.find_next(8001), occupancy_bitmap::npos);
+	BOOST_CHECK_EQUAL(bits.find_next(64 * 64 * 2), occupancy_bitmap::npos);
+}
+
+/*Brief- checks that weighted round-robin serves each level up to its weight per round*/
+BOOST_AUTO_TEST_CASE(weighted_round_robin_order)
+{
+	fixed_priority_multi_queue<string, ring_buffer<string>, no_stats, weighted_round_robin> queue(weighted_round_robin({ 3, 1, 2 }));
+	for (int i = 0; i < 6; ++i) {
+		queue.push("a" + to_string(i), 0);
+		queue.push("b" + to_string(i), 1);
+	}
+	queue.push("c0", 2);
+
+	vector<string> served;
+	while (!queue.empty()) {
+		served.push_back(queue.top());
+		queue.pop();
+	}
+	vector<string> const expected{ "a0", "a1", "a2", "b0", "c0", "a3", "a4", "a5", "b1", "b2", "b3", "b4", "b5" };
+	BOOST_CHECK_EQUAL_COLLECTIONS(served.begin(), served.end(), expected.begin(), expected.end());
+}
+
+/*Brief- checks that low priorities are not starved while a high priority level is kept full*/
+BOOST_AUTO_TEST_CASE(weighted_round_robin_no_starvation)
+{
+	fixed_priority_multi_queue<int, ring_buffer<int>, no_stats, weighted_round_robin> queue(weighted_round_robin({ 4 }));
+	for (int i = 0; i < 4; ++i)
+		queue.push(i, 0);
+	queue.push(-1, 7);
+	int served = 0;
+	for (; queue.top() != -1; ++served) {
+		queue.pop();
+		queue.push(served, 0);
+	}
+	BOOST_CHECK_EQUAL(served, 4);
+}
+
+/*Brief- element cost used by the deficit round-robin tests*/
+struct length_cost
+{
+	size_t operator () (string const& s) const noexcept { return s.size(); }
+};
+
+/*Brief- checks that deficit round-robin shares service by cost, and that try_pop and pop_n follow the same schedule*/
+BOOST_AUTO_TEST_CASE(deficit_round_robin_order)
+{
+	using schedule = deficit_round_robin<length_cost>;
+	fixed_priority_multi_queue<string, ring_buffer<string>, no_stats, schedule> queue(schedule({}, 4));
+	for (string s : { "aa", "aa", "aaaa", "a" })
+		queue.push(s, 0);
+	for (string s : { "bbbbbb", "b" })
+		queue.push(s, 1);
+
+	// round 1: level 0 spends 2+2 of 4, level 1 cannot afford 6; round 2: level 0 spends 4, level 1 has 8
+	vector<string> served;
+	served.push_back(*queue.try_pop());
+	queue.pop_n(back_inserter(served), 3);
+	string value;
+	while (queue.try_pop(value))
+		served.push_back(value);
+	vector<string> const expected{ "aa", "aa", "aaaa", "bbbbbb", "b", "a" };
+	BOOST_CHECK_EQUAL_COLLECTIONS(served.begin(), served.end(), expected.begin(), expected.end());
+	BOOST_CHECK_THROW(schedule({ 1, 0 }), invalid_argument);
+}
+
+/*Brief- checks that a copied queue keeps its weights and follows its own round*/
+BOOST_AUTO_TEST_CASE(schedule_copy)
+{
+	using queue_t = fixed_priority_multi_queue<int, ring_buffer<int>, no_stats, weighted_round_robin>;
+	queue_t queue(weighted_round_robin({ 2, 1 }));
+	queue.schedule().set_quantum(1, 2);
+	for (int i = 0; i < 4; ++i) {
+		queue.push(i, 0);
+		queue.push(10 + i, 1);
+	}
+	queue_t copy(queue);
+	BOOST_CHECK_EQUAL(copy.schedule().quantum(1), 2);
+
+	vector<int> served;
+	copy.pop_n(back_inserter(served), 8);
+	vector<int> const expected{ 0, 1, 10, 11, 2, 3, 12, 13 };
+	BOOST_CHECK_EQUAL_COLLECTIONS(served.begin(), served.end(), expected.begin(), expected.end());
+	BOOST_CHECK_EQUAL(queue.size(), 8);
+}
+
+//=============================================
+//AGING TESTS
+//=============================================
+
+/*Brief- checks that under sustained high-priority load a waiting element climbs one level per dequeue threshold*/
+BOOST_AUTO_TEST_CASE(aging_promotes_by_dequeues)
+{
+	using queue_t = fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<>, strict_priority, level_aging<>>;
+	queue_t queue(level_aging<>(4));
+	queue.push(-1, 2);
+	for (int i = 0; i < 10; ++i)
+		queue.push(i, 0);
+
+	// without aging -1 would never be served; after 8 dequeues it joins level 0 behind 9 elements
+	int served = 0;
+	for (; queue.top() != -1 && served < 100; ++served) {
+		queue.pop();
+		queue.push(served, 0);
+	}
+	BOOST_CHECK_EQUAL(served, 17);
+
+	auto const stats = queue.stats();
+	BOOST_CHECK_EQUAL(stats.levels[2].promoted, 1);
+	BOOST_CHECK_EQUAL(stats.levels[1].promoted, 1);
+	BOOST_CHECK_EQUAL(queue.aging().age_threshold(), 4);
+}
+
+/*Brief- checks that a run of elements is promoted together, keeps its FIFO order and its timestamps*/
+BOOST_AUTO_TEST_CASE(aging_promotes_runs_in_order)
+{
+	using queue_t = fixed_priority_multi_queue<string, ring_buffer<string>, level_stats<true>, strict_priority, level_aging<>>;
+	queue_t queue(level_aging<>(16));
+	for (int i = 0; i < 5; ++i)
+		queue.push("low" + to_string(i), 1);
+	for (int i = 0; i < 4; ++i)
+		queue.push("high", 0);
+
+	vector<string> served;
+	for (int i = 0; i < 30; ++i) {
+		queue.pop_n(back_inserter(served), 1);
+		queue.push("high", 0);
+	}
+	while (!queue.empty())
+		queue.pop_n(back_inserter(served), 1);
+
+	auto const first = find(served.begin(), served.end(), "low0");
+	BOOST_REQUIRE(first + 5 <= served.end());
+	BOOST_CHECK_EQUAL(first - served.begin(), 19);
+	for (int i = 0; i < 5; ++i)
+		BOOST_CHECK_EQUAL(first[i], "low" + to_string(i));
+
+	auto const stats = queue.stats();
+	BOOST_CHECK_EQUAL(stats.levels[1].promoted, 5);
+	BOOST_CHECK_EQUAL(stats.levels[0].pops, served.size());
+	BOOST_CHECK_EQUAL(accumulate(stats.sojourn[0].begin(), stats.sojourn[0].end(), uint64_t(0)), served.size());
+}
+
+/*Brief- checks that one dequeue promotes at most the limit, and the following dequeues come back for the rest of the run*/
+BOOST_AUTO_TEST_CASE(aging_limits_promotion_per_dequeue)
+{
+	using queue_t = fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<>, strict_priority, level_aging<>>;
+	BOOST_CHECK_THROW(level_aging<>(4, 0), invalid_argument);
+	queue_t queue(level_aging<>(4, 16));
+	BOOST_CHECK_EQUAL(queue.aging().promotion_limit(), 16);
+	for (int i = 0; i < 50; ++i)
+		queue.push(i, 2);
+	for (int i = 0; i < 20; ++i)
+		queue.push(-1, 0);
+
+	for (int i = 0; i < 3; ++i)
+		queue.pop();
+	BOOST_CHECK_EQUAL(queue.stats().levels[2].promoted, 0);
+	// level 1 is occupied after the first batch, but the rest of the run is promoted before it is checked
+	for (auto expected : { 16, 32, 48, 50 })
+	{
+		queue.pop();
+		BOOST_CHECK_EQUAL(queue.stats().levels[2].promoted, expected);
+	}
+
+	while (queue.top() == -1)
+		queue.pop();
+	for (int i = 0; i < 50; ++i)
+	{
+		BOOST_REQUIRE_EQUAL(queue.top(), i);
+		queue.pop();
+	}
+}
+
+/*Brief- checks aging measured with a steady clock*/
+BOOST_AUTO_TEST_CASE(aging_by_time)
+{
+	using aging = level_aging<chrono::steady_clock>;
+	fixed_priority_multi_queue<int, ring_buffer<int>, no_stats, strict_priority, aging> queue(aging(chrono::milliseconds(1)));
+	queue.push(-1, 2);
+	queue.push(0, 0);
+
+	int served = 0;
+	for (; queue.top() != -1 && served < 1000; ++served) {
+		this_thread::sleep_for(chrono::microseconds(500));
+		queue.pop();
+		queue.push(served, 0);
+	}
+	BOOST_CHECK_LT(served, 1000);
+	BOOST_CHECK_GE(served, 2);
+}
+
+/*Brief- checks that aging combines with weighted round-robin and survives copies*/
+BOOST_AUTO_TEST_CASE(aging_with_round_robin)
+{
+	using queue_t = fixed_priority_multi_queue<int, ring_buffer<int>, no_stats, weighted_round_robin, level_aging<>>;
+	queue_t queue(weighted_round_robin({ 8, 1, 1, 1 }), level_aging<>(2));
+	for (int p = 0; p < 4; ++p)
+		for (int i = 0; i < 8; ++i)
+			queue.push(p, p);
+
+	queue_t copy(queue);
+	vector<int> served;
+	copy.pop_n(back_inserter(served), 32);
+	BOOST_CHECK(copy.empty());
+	BOOST_CHECK_EQUAL(count(served.begin(), served.end(), 3), 8);
+	BOOST_CHECK_EQUAL(queue.size(), 32);
+}
+
+/*Brief- checks that the default policy never reorders levels*/
+BOOST_AUTO_TEST_CASE(aging_disabled)
+{
+	fixed_priority_multi_queue<int> queue;
+	queue.push(1, 1);
+	for (int i = 0; i < 100; ++i) {
+		queue.push(0, 0);
+		queue.pop();
+	}
+	BOOST_CHECK_EQUAL(queue.top(), 1);
+}
+
+//=============================================
+//SHARDED QUEUE TESTS
+//=============================================
+
+/*Brief- checks that a worker serves its own shard and steals from another once it runs dry*/
+BOOST_AUTO_TEST_CASE(sharded_local_then_steal)
+{
+	sharded_multi_queue<int> queue(3, 100);
+	queue.push(0, 10, 5);
+	queue.push(0, 11, 5);
+	queue.push(1, 20, 0);
+	BOOST_CHECK_EQUAL(queue.size(), 3);
+
+	// within the relaxation bound the local top wins over the better remote one
+	int value = 0;
+	BOOST_CHECK(queue.try_pop(0, value));
+	BOOST_CHECK_EQUAL(value, 10);
+
+	// shard 2 is empty, so it steals the best advertised element
+	BOOST_CHECK(queue.try_pop(2, value));
+	BOOST_CHECK_EQUAL(value, 20);
+	BOOST_CHECK(queue.try_pop(2, value));
+	BOOST_CHECK_EQUAL(value, 11);
+	BOOST_CHECK(!queue.try_pop(2, value));
+	BOOST_CHECK(queue.empty());
+	BOOST_CHECK_THROW(queue.push(3, 1, 0), out_of_range);
+	BOOST_CHECK_THROW(sharded_multi_queue<int>(0), invalid_argument);
+}
+
+/*Brief- checks that the relaxation bound makes a worker take remote work that is better by more than the bound*/
+BOOST_AUTO_TEST_CASE(sharded_relaxation_bound)
+{
+	sharded_multi_queue<string> queue(2, 2);
+	queue.push(0, "local", 4);
+	queue.push(1, "near", 2);
+	string value;
+	BOOST_CHECK(queue.try_pop(0, value));
+	BOOST_CHECK_EQUAL(value, "local");
+
+	queue.push(0, "local", 4);
+	queue.push(1, "far", 1);
+	BOOST_CHECK(queue.try_pop(0, value));
+	BOOST_CHECK_EQUAL(value, "far");
+	BOOST_CHECK_EQUAL(queue.relaxation_bound(), 2);
+}
+
+/*Brief- checks that thieves pop only the lock-free window, and that the owner's backlog moves into it in FIFO order as the owner works*/
+BOOST_AUTO_TEST_CASE(sharded_window_and_backlog)
+{
+	sharded_multi_queue<int> queue(2, 0, 4, 2);
+	BOOST_CHECK_EQUAL(queue.max_priority(), 4);
+	BOOST_CHECK_THROW(queue.push(0, 1, 4), out_of_range);
+	for (auto i = 0; i < 5; ++i)
+		queue.push(0, i, 1);
+
+	// the window holds two elements of the level; the other three wait in the owner's backlog
+	int value = 0;
+	for (auto expected : { 0, 1 })
+	{
+		BOOST_CHECK(queue.try_pop(1, value));
+		BOOST_CHECK_EQUAL(value, expected);
+	}
+	BOOST_CHECK(!queue.try_pop(1, value));
+	BOOST_CHECK_EQUAL(queue.size(), 3);
+
+	// the owner's push refills the window first, so the thief keeps the level's order behind the better element
+	queue.push(0, 10, 0);
+	for (auto expected : { 10, 2, 3 })
+	{
+		BOOST_CHECK(queue.try_pop(1, value));
+		BOOST_CHECK_EQUAL(value, expected);
+	}
+	BOOST_CHECK(!queue.try_pop(1, value));
+	BOOST_CHECK(queue.try_pop(0, value));
+	BOOST_CHECK_EQUAL(value, 4);
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks that concurrent workers pushing to their own shards and stealing deliver every element exactly once*/
+BOOST_AUTO_TEST_CASE(sharded_concurrent_workers)
+{
+	size_t const workers = 4;
+	int const perProducer = 6000;
+	size_t const total = (workers - 1) * perProducer;
+	sharded_multi_queue<int> queue(workers, 1);
+	vector<vector<int>> served(workers);
+	atomic<size_t> remaining{ total };
+
+	vector<thread> threads;
+	for (size_t w = 0; w < workers; ++w)
+		threads.emplace_back([&, w] {
+			// the last worker only steals
+			if (w + 1 != workers)
+				for (int i = 0; i < perProducer; ++i)
+					queue.push(w, int(w) * 1'000'000 + i, i % 7);
+			int value;
+			while (remaining.load() != 0)
+				if (queue.try_pop(w, value)) {
+					served[w].push_back(value);
+					--remaining;
+				}
+		});
+	for (auto& t : threads)
+		t.join();
+
+	vector<int> all;
+	for (auto const& s : served)
+		all.insert(all.end(), s.begin(), s.end());
+	sort(all.begin(), all.end());
+	BOOST_CHECK_EQUAL(all.size(), total);
+	BOOST_CHECK(adjacent_find(all.begin(), all.end()) == all.end());
+	BOOST_CHECK(queue.empty());
+}
+
+//=============================================
+//RELAXED QUEUE TESTS
+//=============================================
+
+/*Brief- checks that a relaxed queue with a single instance degenerates to strict priority order*/
+BOOST_AUTO_TEST_CASE(relaxed_single_instance)
+{
+	relaxed_multi_queue<string> queue(1, 1);
+	BOOST_CHECK_EQUAL(queue.queue_count(), 1);
+	queue.push("c", 2);
+	queue.push("a", 0);
+	string const b = "b";
+	queue.push(b, 1);
+	BOOST_CHECK_EQUAL(queue.size(), 3);
+
+	string value;
+	for (string expected : { "a", "b", "c" }) {
+		BOOST_CHECK(queue.try_pop(value));
+		BOOST_CHECK_EQUAL(value, expected);
+	}
+	BOOST_CHECK(!queue.try_pop(value));
+	BOOST_CHECK(queue.empty());
+	BOOST_CHECK_THROW(relaxed_multi_queue<int>(0), invalid_argument);
+}
+
+/*Brief- checks that every element pushed to c*p instances is popped, roughly in priority order*/
+BOOST_AUTO_TEST_CASE(relaxed_drains_everything)
+{
+	relaxed_multi_queue<int> queue(4, 2);
+	BOOST_CHECK_EQUAL(queue.queue_count(), 8);
+	for (int i = 0; i < 1000; ++i)
+		queue.push(i, i % 10);
+
+	vector<int> served;
+	int value;
+	while (queue.try_pop(value))
+		served.push_back(value);
+	BOOST_CHECK_EQUAL(served.size(), 1000);
+	BOOST_CHECK(queue.empty());
+
+	// two-choice pops keep low priorities near the front: the first tenth holds mostly level 0 and 1
+	auto const early = count_if(served.begin(), served.begin() + 100, [](int v) { return v % 10 < 2; });
+	BOOST_CHECK_GT(early, 50);
+	sort(served.begin(), served.end());
+	BOOST_CHECK(adjacent_find(served.begin(), served.end()) == served.end());
+}
+
+/*Brief- checks that concurrent producers and consumers deliver every element exactly once*/
+BOOST_AUTO_TEST_CASE(relaxed_concurrent)
+{
+	size_t const threads = 4;
+	int const perThread = 5000;
+	relaxed_multi_queue<int> queue(threads);
+	vector<vector<int>> served(threads);
+	atomic<size_t> remaining{ threads * perThread };
+
+	vector<thread> workers;
+	for (size_t t = 0; t < threads; ++t)
+		workers.emplace_back([&, t] {
+			int value;
+			for (int i = 0; i < perThread; ++i) {
+				queue.push(int(t) * perThread + i, i % 5);
+				if (queue.try_pop(value)) {
+					served[t].push_back(value);
+					--remaining;
+				}
+			}
+			while (remaining.load() != 0)
+				if (queue.try_pop(value)) {
+					served[t].push_back(value);
+					--remaining;
+				}
+		});
+	for (auto& w : workers)
+		w.join();
+
+	vector<int> all;
+	for (auto const& s : served)
+		all.insert(all.end(), s.begin(), s.end());
+	sort(all.begin(), all.end());
+	BOOST_CHECK_EQUAL(all.size(), threads * perThread);
+	BOOST_CHECK(adjacent_find(all.begin(), all.end()) == all.end());
+}
+
+//=============================================
+//SPARSE QUEUE TESTS
+//=============================================
+
+/*Brief- checks that widely spread keys are served in order while only occupied levels are indexed*/
+BOOST_AUTO_TEST_CASE(sparse_order_and_level_count)
+{
+	sparse_priority_multi_queue<int> queue;
+	queue.push(3, 1000000000000ull);
+	queue.push(1, 7);
+	queue.push(2, 1000000);
+	queue.push(4, 1000000000000ull);
+	queue.push(0, 0);
+	BOOST_CHECK_EQUAL(queue.size(), 5);
+	BOOST_CHECK_EQUAL(queue.level_count(), 4);
+	BOOST_CHECK_EQUAL(queue.top_priority(), 0);
+
+	for (auto expected : { 0, 1, 2, 3, 4 })
+	{
+		BOOST_CHECK_EQUAL(queue.top(), expected);
+		queue.pop();
+	}
+	BOOST_CHECK(queue.empty());
+	BOOST_CHECK_EQUAL(queue.level_count(), 0);
+	BOOST_CHECK(!queue.try_pop());
+}
+
+/*Brief- checks that drained levels are reused for new keys and that elements keep FIFO order within a level*/
+BOOST_AUTO_TEST_CASE(sparse_reuses_levels)
+{
+	sparse_priority_multi_queue<string> queue;
+	for (size_t round = 0; round < 100; ++round)
+	{
+		size_t const key = round * 1000003;
+		queue.push("a" + to_string(round), key);
+		queue.push("b" + to_string(round), key);
+		BOOST_CHECK_EQUAL(*queue.try_pop(), "a" + to_string(round));
+		string value;
+		BOOST_CHECK(queue.try_pop(value));
+		BOOST_CHECK_EQUAL(value, "b" + to_string(round));
+	}
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- compares a sparse queue against a dense one over random pushes and pops*/
+BOOST_AUTO_TEST_CASE(sparse_matches_dense)
+{
+	sparse_priority_multi_queue<int> sparse;
+	fixed_priority_multi_queue<int> dense;
+	srand(21);
+	for (auto i = 0; i < 5000; ++i)
+	{
+		if (rand() % 3 != 0 || dense.empty())
+		{
+			size_t const priority = rand() % 300;
+			sparse.push(i, priority);
+			dense.push(i, priority);
+		}
+		else
+		{
+			BOOST_REQUIRE_EQUAL(sparse.top(), dense.top());
+			sparse.pop();
+			dense.pop();
+		}
+		BOOST_REQUIRE_EQUAL(sparse.size(), dense.size());
+	}
+
+	sparse_priority_multi_queue<int> copy(sparse), moved(std::move(sparse));
+	BOOST_CHECK(sparse.empty());
+	while (!dense.empty())
+	{
+		BOOST_REQUIRE_EQUAL(copy.top(), dense.top());
+		BOOST_REQUIRE_EQUAL(moved.top(), dense.top());
+		copy.pop();
+		moved.pop();
+		dense.pop();
+	}
+	BOOST_CHECK(copy.empty() && moved.empty());
+}
+
+//=============================================
+//TRIMMING TESTS
+//=============================================
+
+/*Brief- checks that shrink_to_fit drops the empty levels past the last occupied one and keeps the elements in order*/
+BOOST_AUTO_TEST_CASE(shrink_to_fit_drops_trailing_levels)
+{
+	fixed_priority_multi_queue<string> queue;
+	queue.push("far", 100000);
+	queue.pop();
+	BOOST_CHECK_EQUAL(queue.max_priority(), 100001);
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(queue.max_priority(), 0);
+
+	for (auto i = 0; i < 100; ++i)
+		queue.push(to_string(i), i % 2 == 0 ? 3 : 500);
+	queue.push("gone", 9000);
+	for (auto i = 0; i < 50; ++i)
+		queue.pop();
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(queue.max_priority(), 9001);
+	BOOST_CHECK_EQUAL(queue.size(), 51);
+	for (auto i = 1; i < 100; i += 2)
+	{
+		BOOST_CHECK_EQUAL(queue.top(), to_string(i));
+		queue.pop();
+	}
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(queue.max_priority(), 9001);
+	queue.pop();
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(queue.max_priority(), 0);
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks that ring_buffer::shrink_to_fit frees an empty buffer and halves a mostly drained one*/
+BOOST_AUTO_TEST_CASE(ring_buffer_shrink_to_fit)
+{
+	ring_buffer<string> buffer;
+	for (auto i = 0; i < 1000; ++i)
+		buffer.push(to_string(i));
+	BOOST_CHECK_EQUAL(buffer.capacity(), 1024);
+	for (auto i = 0; i < 990; ++i)
+		buffer.pop();
+	buffer.shrink_to_fit();
+	BOOST_CHECK_EQUAL(buffer.capacity(), 16);
+	BOOST_CHECK_EQUAL(buffer.front(), "990");
+	BOOST_CHECK_EQUAL(buffer.back(), "999");
+	buffer.clear();
+	buffer.shrink_to_fit();
+	BOOST_CHECK_EQUAL(buffer.capacity(), 0);
+	buffer.push("again");
+	BOOST_CHECK_EQUAL(buffer.front(), "again");
+}
+
+/*Brief- checks that a pooled queue hands the chunks of its drained levels back to the system*/
+BOOST_AUTO_TEST_CASE(pooled_queue_shrink_to_fit)
+{
+	pooled_fixed_priority_multi_queue<int, 16> queue;
+	for (auto i = 0; i < 1000; ++i)
+		queue.push(i, i % 8);
+	auto& pool = queue.get_allocator().resource();
+	auto const peak = pool.allocated_chunks();
+	for (auto i = 0; i < 990; ++i)
+		queue.pop();
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(pool.free_chunks(), 0);
+	BOOST_CHECK_LT(pool.allocated_chunks(), peak / 10);
+	BOOST_CHECK_EQUAL(queue.size(), 10);
+	BOOST_CHECK_EQUAL(queue.top(), 7 + 8 * 115);
+}
+
+/*Brief- checks that the schedule, aging and stats policies keep working across a shrink*/
+BOOST_AUTO_TEST_CASE(shrink_to_fit_with_policies)
+{
+	fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<true>, weighted_round_robin, level_aging<>> queue(weighted_round_robin({ 2, 1 }), level_aging<>(1000));
+	for (auto i = 0; i < 60; ++i)
+		queue.push(i, i % 6);
+	size_t popped = 0;
+	for (; queue.top_priority() < 3; ++popped)
+		queue.pop();
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(queue.max_priority(), 6);
+	BOOST_CHECK_EQUAL(queue.schedule().quantum(0), 2);
+
+	for (auto i = 0; i < 20; ++i)
+		queue.push(100 + i, i % 2);
+	for (; !queue.empty(); ++popped)
+		queue.pop();
+	BOOST_CHECK_EQUAL(popped, 80);
+	auto const stats = queue.stats();
+	BOOST_CHECK_EQUAL(accumulate(stats.levels.begin(), stats.levels.end(), size_t(0), [](size_t n, multi_queue_stats::level const& l) { return n + l.pops; }), 80);
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(queue.max_priority(), 0);
+	BOOST_CHECK_EQUAL(queue.stats().levels.size(), 6);
+	BOOST_CHECK_EQUAL(queue.stats().levels[5].pushes, 10);
+}
+
+/*Brief- checks that watermark_trim shrinks once the load stays low and leaves a recurring burst alone*/
+BOOST_AUTO_TEST_CASE(watermark_trim_hysteresis)
+{
+	fixed_priority_multi_queue<int, ring_buffer<int>, no_stats, strict_priority, no_aging, watermark_trim> queue;
+	queue.trimming() = watermark_trim(64, 4);
+	BOOST_CHECK_THROW(watermark_trim(64, 1), std::invalid_argument);
+
+	// bursts of 1000 that drain to 300 every window: the load returns to the mark, so nothing is trimmed
+	for (auto round = 0; round < 20; ++round)
+	{
+		while (queue.size() < 1000)
+			queue.push(round, 50 + queue.size() % 50);
+		for (auto i = 0; i < 700; ++i)
+			queue.pop();
+	}
+	BOOST_CHECK_EQUAL(queue.max_priority(), 100);
+
+	// the load falls to a handful of elements on level 0; the backlog drains and the queue shrinks
+	while (!queue.empty())
+		queue.pop();
+	for (auto i = 0; i < 1000; ++i)
+	{
+		queue.push(i, 0);
+		queue.pop();
+	}
+	BOOST_CHECK_EQUAL(queue.max_priority(), 1);
+
+	// the policy alone: a trim is due only after a whole window stayed at or below a quarter of the mark
+	watermark_trim trim(10, 4);
+	trim.on_push(1000);
+	size_t trims = 0;
+	for (size_t size = 1000; size > 300; --size)
+		trims += trim.on_pop(size);
+	BOOST_CHECK_EQUAL(trims, 0);
+	for (auto i = 0; i < 19; ++i)	// the first low window opened at 301
+		BOOST_CHECK(!trim.on_pop(200));
+	BOOST_CHECK(trim.on_pop(200));
+}
+
+/*Brief- checks that pop_n reports every element it dequeues, so draining in batches closes the windows a pop loop would*/
+BOOST_AUTO_TEST_CASE(watermark_trim_through_pop_n)
+{
+	fixed_priority_multi_queue<int, ring_buffer<int>, no_stats, strict_priority, no_aging, watermark_trim> queue;
+	queue.trimming() = watermark_trim(64, 4);
+	for (auto i = 0; i < 1000; ++i)
+		queue.push(i, 50 + i % 50);
+
+	// twenty elements a level, each level taken as one batch; a call per batch would not even close a window
+	vector<int> out;
+	queue.pop_n(back_inserter(out), 1000);
+	BOOST_CHECK_EQUAL(out.size(), 1000);
+	BOOST_CHECK_EQUAL(queue.max_priority(), 100);
+
+	// the load falls to small batches on level 0 and the window left open by the drain trims the queue
+	for (auto i = 0; i < 20; ++i)
+	{
+		for (auto j = 0; j < 8; ++j)
+			queue.push(j, 0);
+		queue.pop_n(back_inserter(out), 8);
+	}
+	BOOST_CHECK(queue.empty());
+	BOOST_CHECK_EQUAL(queue.max_priority(), 1);
+
+	// the policy alone: a batch closing two windows opens the second with the elements still to be taken
+	watermark_trim trim(10, 4);
+	trim.on_push(1000);
+	BOOST_CHECK(!trim.on_pop(990, 10));
+	BOOST_CHECK(trim.on_pop(200, 20));
+	BOOST_CHECK(!trim.on_pop(199));
+}
+
+/*Brief- checks that shrinking a sparse queue compacts its levels without disturbing the order*/
+BOOST_AUTO_TEST_CASE(sparse_shrink_to_fit)
+{
+	sparse_priority_multi_queue<int> queue;
+	for (auto i = 0; i < 1000; ++i)
+		queue.push(i, size_t(i % 100) * 1000000);
+	for (auto i = 0; i < 900; ++i)
+		queue.pop();
+	queue.shrink_to_fit();
+	BOOST_CHECK_EQUAL(queue.level_count(), 10);
+	for (auto level = 90; level < 100; ++level)
+		for (auto i = level; i < 1000; i += 100)
+		{
+			BOOST_REQUIRE_EQUAL(queue.top(), i);
+			queue.pop();
+		}
+	BOOST_CHECK(queue.empty());
+	queue.push(7, 3);
+	BOOST_CHECK_EQUAL(queue.top(), 7);
+}
+
+//=============================================
+//SNAPSHOT TESTS
+//=============================================
+
+namespace
+{
+	struct reading
+	{
+		std::uint32_t	sensor;
+		double			value;
+	};
+
+	template <class QUEUE>
+	void save_to(QUEUE const& queue, char const* path)
+	{
+		ofstream out(path, ios::binary);
+		queue.save(out);
+	}
+}
+
+/*Brief- checks that a saved queue reads back level by level, wrapped levels and empty levels included*/
+BOOST_AUTO_TEST_CASE(snapshot_round_trip)
+{
+	char const* path = "ut_multi_queue_snapshot.bin";
+	fixed_priority_multi_queue<int> queue;
+	// leave level 1's ring buffer wrapped around the end of its block
+	for (auto i = 0; i < 8; ++i)
+		queue.push(i, 1);
+	for (auto i = 0; i < 5; ++i)
+		queue.pop();
+	for (auto i = 8; i < 12; ++i)
+		queue.push(i, 1);
+	queue.push(100, 0);
+	queue.push(300, 3);
+	queue.push(301, 3);
+	save_to(queue, path);
+
+	{
+		multi_queue_snapshot<int> snapshot(path);
+		BOOST_CHECK_EQUAL(snapshot.level_count(), 4);
+		BOOST_CHECK_EQUAL(snapshot.size(), 10);
+		BOOST_CHECK_EQUAL(snapshot.level_size(0), 1);
+		BOOST_CHECK_EQUAL(snapshot.level_size(1), 7);
+		BOOST_CHECK_EQUAL(snapshot.level_size(2), 0);
+		for (auto i = 0; i < 7; ++i)
+			BOOST_CHECK_EQUAL(snapshot.level_data(1)[i], i + 5);
+		for (unsigned p = 0; p < snapshot.level_count(); ++p)
+			BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(snapshot.level_data(p)) % alignof(int), 0u);
+
+		fixed_priority_multi_queue<int> restored(snapshot);
+		BOOST_CHECK_EQUAL(restored.size(), queue.size());
+		BOOST_CHECK_EQUAL(restored.max_priority(), queue.max_priority());
+		for (; !queue.empty(); queue.pop(), restored.pop())
+			BOOST_REQUIRE_EQUAL(restored.top(), queue.top());
+		BOOST_CHECK(restored.empty());
+	}
+	std::remove(path);
+}
+
+/*Brief- checks restoring structs into chunked levels, and that the policies count the restored elements as pushes*/
+BOOST_AUTO_TEST_CASE(snapshot_restores_structs_and_policies)
+{
+	char const* path = "ut_multi_queue_snapshot_structs.bin";
+	fixed_priority_multi_queue<reading, chunked_queue<reading, std::allocator<reading>, 4>> queue;
+	for (std::uint32_t i = 0; i < 30; ++i)
+		queue.push(reading{ i, i * 0.5 }, i % 3);
+	queue.pop();
+	save_to(queue, path);
+
+	{
+		multi_queue_snapshot<reading> snapshot(path);
+		fixed_priority_multi_queue<reading, ring_buffer<reading>, level_stats<>> restored(snapshot);
+		BOOST_CHECK_EQUAL(restored.size(), 29);
+		auto const stats = restored.stats();
+		BOOST_CHECK_EQUAL(stats.levels[0].pushes, 9);
+		BOOST_CHECK_EQUAL(stats.levels[1].pushes, 10);
+		BOOST_CHECK_EQUAL(stats.levels[2].max_depth, 10);
+
+		for (; !queue.empty(); queue.pop(), restored.pop())
+		{
+			BOOST_REQUIRE_EQUAL(restored.top().sensor, queue.top().sensor);
+			BOOST_REQUIRE_EQUAL(restored.top().value, queue.top().value);
+		}
+	}
+
+	fixed_priority_multi_queue<reading> empty;
+	save_to(empty, path);
+	{
+		multi_queue_snapshot<reading> snapshot(path);
+		BOOST_CHECK_EQUAL(snapshot.level_count(), 0);
+		fixed_priority_multi_queue<reading> restored(snapshot);
+		BOOST_CHECK(restored.empty());
+	}
+	std::remove(path);
+}
+
+/*Brief- checks that missing, foreign, mismatched and truncated files are rejected*/
+BOOST_AUTO_TEST_CASE(snapshot_rejects_bad_files)
+{
+	char const* path = "ut_multi_queue_snapshot_bad.bin";
+	BOOST_CHECK_THROW(multi_queue_snapshot<int>{ "ut_multi_queue_no_such_file.bin" }, std::runtime_error);
+
+	{
+		ofstream out(path, ios::binary);
+		out << "not a snapshot, just some text that is long enough to fill a header";
+	}
+	BOOST_CHECK_THROW(multi_queue_snapshot<int>{ path }, std::runtime_error);
+
+	fixed_priority_multi_queue<int> queue;
+	for (auto i = 0; i < 100; ++i)
+		queue.push(i, i % 5);
+	save_to(queue, path);
+	BOOST_CHECK_NO_THROW(multi_queue_snapshot<int>{ path });
+	BOOST_CHECK_THROW(multi_queue_snapshot<double>{ path }, std::runtime_error);
+
+	ostringstream whole;
+	queue.save(whole);
+	string const bytes = whole.str();
+	{
+		ofstream out(path, ios::binary);
+		out.write(bytes.data(), bytes.size() - 64);
+	}
+	BOOST_CHECK_THROW(multi_queue_snapshot<int>{ path }, std::runtime_error);
+	std::remove(path);
+}
+
+//=============================================
+//MERGE AND SPLICE TESTS
+//=============================================
+
+/*Brief- checks that merge appends every level of the source behind the matching level, linking chunks without moving elements*/
+BOOST_AUTO_TEST_CASE(merge_links_chunked_levels)
+{
+	using queue_t = fixed_priority_multi_queue<string, chunked_queue<string, std::allocator<string>, 4>>;
+	queue_t target, source;
+	for (auto i = 0; i < 6; ++i)
+		target.push("t" + to_string(i), i % 2 == 0 ? 0 : 2);
+	for (auto i = 0; i < 10; ++i)
+		source.push("s" + to_string(i), i % 5);
+	source.pop();
+
+	string const* linked = &source.top();
+	target.merge(std::move(source));
+	BOOST_CHECK(source.empty());
+	BOOST_CHECK_EQUAL(target.size(), 15);
+	BOOST_CHECK_EQUAL(target.max_priority(), 5);
+
+	vector<string> expected = { "t0", "t2", "t4", "s5", "s1", "s6", "t1", "t3", "t5", "s2", "s7", "s3", "s8", "s4", "s9" };
+	for (auto const& e : expected)
+	{
+		if (e == "s5")
+			BOOST_CHECK_EQUAL(&target.top(), linked);
+		BOOST_REQUIRE_EQUAL(target.top(), e);
+		target.pop();
+	}
+	BOOST_CHECK(target.empty());
+
+	source.push("again", 1);
+	BOOST_CHECK_EQUAL(source.top(), "again");
+}
+
+/*Brief- checks that splice moves a single level and leaves the source's other levels in place*/
+BOOST_AUTO_TEST_CASE(splice_moves_one_level)
+{
+	fixed_priority_multi_queue<int> target, source;
+	target.push(1, 1);
+	for (auto i = 0; i < 20; ++i)
+		source.push(i, i % 4);
+
+	target.splice(source, 1);
+	BOOST_CHECK_EQUAL(target.size(), 6);
+	BOOST_CHECK_EQUAL(source.size(), 15);
+	target.splice(source, 1);
+	target.splice(source, 99);
+	target.splice(target, 0);
+	BOOST_CHECK_EQUAL(target.size(), 6);
+
+	vector<int> expected = { 1, 1, 5, 9, 13, 17 };
+	for (auto e : expected)
+	{
+		BOOST_REQUIRE_EQUAL(target.top(), e);
+		target.pop();
+	}
+	for (auto i : { 0, 4, 8, 12, 16, 2 })
+	{
+		BOOST_REQUIRE_EQUAL(source.top(), i);
+		source.pop();
+	}
+
+	// the emptied level takes the whole block of the next splice
+	source.splice(target, 0);
+	target.push(7, 0);
+	source.merge(std::move(target));
+	BOOST_CHECK_EQUAL(source.size(), 10);
+	BOOST_CHECK_EQUAL(source.top(), 7);
+}
+
+/*Brief- checks merging pooled queues, whose chunks belong to different pools and are moved element by element*/
+BOOST_AUTO_TEST_CASE(merge_pooled_queues)
+{
+	pooled_fixed_priority_multi_queue<string> target, source;
+	for (auto i = 0; i < 50; ++i)
+	{
+		target.push("t" + to_string(i), 3);
+		source.push("s" + to_string(i), 3);
+	}
+	target.merge(std::move(source));
+	BOOST_CHECK(source.empty());
+	for (auto i = 0; i < 100; ++i)
+	{
+		BOOST_REQUIRE_EQUAL(target.top(), (i < 50 ? "t" + to_string(i) : "s" + to_string(i - 50)));
+		target.pop();
+	}
+}
+
+/*Brief- checks that spliced elements count as pushes, keep their timestamps and keep the age the source measured*/
+BOOST_AUTO_TEST_CASE(merge_hands_over_policy_state)
+{
+	using stamped_t = fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<true>>;
+	stamped_t stamped, other;
+	for (auto i = 0; i < 8; ++i)
+	{
+		stamped.push(i, 0);
+		other.push(i, i % 2);
+	}
+	stamped.merge(std::move(other));
+	auto stats = stamped.stats();
+	BOOST_CHECK_EQUAL(stats.levels[0].pushes, 12);
+	BOOST_CHECK_EQUAL(stats.levels[1].pushes, 4);
+	BOOST_CHECK_EQUAL(stats.levels[0].max_depth, 12);
+	while (!stamped.empty())
+		stamped.pop();
+	stats = stamped.stats();
+	BOOST_CHECK_EQUAL(accumulate(stats.sojourn[0].begin(), stats.sojourn[0].end(), uint64_t(0)), 12);
+	BOOST_CHECK_EQUAL(accumulate(stats.sojourn[1].begin(), stats.sojourn[1].end(), uint64_t(0)), 4);
+
+	// -1 has waited 3 dequeues in its source, so the next dequeue here reaches the threshold of 4
+	using aging_t = fixed_priority_multi_queue<int, ring_buffer<int>, level_stats<>, strict_priority, level_aging<>>;
+	aging_t target(level_aging<>(4)), source(level_aging<>(4));
+	for (auto i = 0; i < 10; ++i)
+		target.push(i, 0);
+	for (auto i = 0; i < 6; ++i)
+		target.pop();
+	source.push(-1, 1);
+	for (auto i = 0; i < 3; ++i)
+	{
+		source.push(i, 0);
+		source.pop();
+	}
+	target.merge(std::move(source));
+	target.pop();
+	BOOST_CHECK_EQUAL(target.stats().levels[1].promoted, 1);
+	vector<int> rest;
+	target.pop_n(back_inserter(rest), 10);
+	BOOST_CHECK((rest == vector<int>{ 7, 8, 9, -1 }));
+}
+
+//=============================================
+//TRACKED ELEMENT TESTS
+//=============================================
+
+/*Brief- checks that erase removes tracked elements from the front, middle and back of their levels*/
+BOOST_AUTO_TEST_CASE(tracked_erase)
+{
+	tracked_fixed_priority_multi_queue<string> queue;
+	vector<tracked_fixed_priority_multi_queue<string>::handle> handles;
+	for (auto i = 0; i < 9; ++i)
+		handles.push_back(queue.push_tracked("job" + to_string(i), i % 3));
+	queue.push("untracked", 1);
+	BOOST_CHECK_EQUAL(*handles[4], "job4");
+	BOOST_CHECK_EQUAL(handles[4]->size(), 4);
+	BOOST_CHECK_EQUAL(queue.priority_of(handles[5]), 2);
+
+	queue.erase(handles[0]);	// front of level 0
+	queue.erase(handles[4]);	// middle of level 1
+	queue.erase(handles[8]);	// back of level 2
+	BOOST_CHECK_EQUAL(queue.size(), 7);
+	queue.erase(handles[3]);
+	queue.erase(handles[6]);	// level 0 is now empty
+	BOOST_CHECK_EQUAL(queue.top_priority(), 1);
+
+	vector<string> served;
+	queue.pop_n(back_inserter(served), 10);
+	BOOST_CHECK((served == vector<string>{ "job1", "job7", "untracked", "job2", "job5" }));
+	BOOST_CHECK(queue.empty());
+
+	handles[0] = queue.push_tracked("last", 4);
+	queue.erase(handles[0]);
+	BOOST_CHECK(queue.empty());
+}
+
+/*Brief- checks that change_priority moves an element to the back of its new level and keeps its handle valid*/
+BOOST_AUTO_TEST_CASE(tracked_change_priority)
+{
+	fixed_priority_multi_queue<int, linked_queue<int>, level_stats<true>> queue;
+	for (auto i = 0; i < 4; ++i)
+		queue.push(i, 0);
+	auto const bumped = queue.push_tracked(100, 5);
+	auto const demoted = queue.push_tracked(200, 0);
+	queue.push(300, 5);
+
+	queue.change_priority(bumped, 0);
+	queue.change_priority(demoted, 9);
+	queue.change_priority(bumped, 0);
+	BOOST_CHECK_EQUAL(queue.priority_of(bumped), 0);
+	BOOST_CHECK_EQUAL(queue.priority_of(demoted), 9);
+	BOOST_CHECK_EQUAL(queue.max_priority(), 10);
+	BOOST_CHECK_EQUAL(queue.size(), 7);
+
+	*demoted = 201;
+	vector<int> served;
+	queue.pop_n(back_inserter(served), 5);
+	BOOST_CHECK((served == vector<int>{ 0, 1, 2, 3, 100 }));
+	queue.change_priority(demoted, 1);
+	queue.pop_n(back_inserter(served), 5);
+	BOOST_CHECK((served == vector<int>{ 0, 1, 2, 3, 100, 201, 300 }));
+
+	// moves are counted apart from erasures, and each arrival counts as a push at its new level
+	auto const stats = queue.stats();
+	BOOST_CHECK_EQUAL(stats.levels[0].moved, 1);
+	BOOST_CHECK_EQUAL(stats.levels[5].moved, 1);
+	BOOST_CHECK_EQUAL(stats.levels[9].moved, 1);
+	BOOST_CHECK_EQUAL(stats.levels[0].pushes, 6);
+	BOOST_CHECK_EQUAL(stats.levels[1].pushes, 1);
+	BOOST_CHECK_EQUAL(accumulate(stats.levels.begin(), stats.levels.end(), uint64_t(0), [](uint64_t sum, auto const& l) { return sum + l.erased; }), 0);
+	uint64_t timed = 0;
+	for (auto const& h : stats.sojourn)
+		timed = accumulate(h.begin(), h.end(), timed);
+	BOOST_CHECK_EQUAL(timed, 7);
+}
+
+/*Brief- checks that handles survive promotion, shrink_to_fit, moves and linking merges*/
+BOOST_AUTO_TEST_CASE(tracked_handles_stay_valid)
+{
+	using queue_t = fixed_priority_multi_queue<int, linked_queue<int>, level_stats<true>, strict_priority, level_aging<>>;
+	queue_t queue(level_aging<>(4));
+	auto const waiting = queue.push_tracked(-1, 2);
+	auto const cancelled = queue.push_tracked(-2, 2);
+	for (auto i = 0; i < 10; ++i)
+		queue.push(i, 0);
+	for (auto i = 0; i < 5; ++i)
+		queue.pop();
+	BOOST_CHECK_LT(queue.priority_of(waiting), 2);
+	BOOST_CHECK_EQUAL(*waiting, -1);
+
+	queue.push(7, 40);
+	queue.shrink_to_fit();
+	queue_t moved(std::move(queue));
+	queue_t other(level_aging<>(4));
+	other.push(5, 1);
+	other.merge(std::move(moved));
+	other.erase(cancelled);
+	other.change_priority(waiting, 0);
+
+	vector<int> served;
+	other.pop_n(back_inserter(served), 20);
+	// the 5 and the 7 reach level 0 by aging while the head of the queue is served
+	BOOST_CHECK((served == vector<int>{ 5, 6, 7, 8, 9, -1, 5, 7 }));
+
+	auto const stats = other.stats();
+	BOOST_CHECK_EQUAL(accumulate(stats.levels.begin(), stats.levels.end(), uint64_t(0), [](uint64_t sum, auto const& l) { return sum + l.erased; }), 1);
+	BOOST_CHECK_EQUAL(accumulate(stats.levels.begin(), stats.levels.end(), uint64_t(0), [](uint64_t sum, auto const& l) { return sum + l.moved; }), 1);
+	uint64_t timed = 0;
+	for (auto const& h : stats.sojourn)
+		timed = accumulate(h.begin(), h.end(), timed);
+	BOOST_CHECK_EQUAL(timed, 8);
+}
+
+/*Brief- checks linked_queue copies, allocator-extended moves and splices between different resources*/
+BOOST_AUTO_TEST_CASE(linked_queue_container)
+{
+	std::pmr::monotonic_buffer_resource first, second;
+	using level_t = linked_queue<string, std::pmr::polymorphic_allocator<string>>;
+	level_t a(&first);
+	for (auto i = 0; i < 5; ++i)
+		a.push(to_string(i));
+	auto const h = a.emplace_tracked("tracked");
+	level_t::tag(h) = 42;
+
+	level_t copy(a);
+	BOOST_CHECK_EQUAL(copy.size(), 6);
+	BOOST_CHECK_EQUAL(copy.back(), "tracked");
+
+	level_t b(std::move(copy), &second);
+	BOOST_CHECK_EQUAL(b.size(), 6);
+	BOOST_CHECK_EQUAL(level_t::tag(b.front_handle()), 0);
+
+	a.erase(h);
+	a.splice(b);
+	BOOST_CHECK_EQUAL(a.size(), 11);
+	BOOST_CHECK(b.empty());
+	vector<string> all;
+	for (; !a.empty(); a.pop())
+		all.push_back(a.front());
+	BOOST_CHECK_EQUAL(all[4], "4");
+	BOOST_CHECK_EQUAL(all[5], "0");
+	BOOST_CHECK_EQUAL(all[10], "tracked");
+}
+
 //=============================================
 //DESTRUCTOR TEST - check for memory leaks
 //=============================================